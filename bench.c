@@ -0,0 +1,1429 @@
+/*
+ * Benchmarks for oaht.h
+ *
+ * Compile with optimizations, e.g.
+ *
+ *     cc -O2 -pthread -o bench bench.c -lm
+ *
+ * and run ./bench to run all the benchmarks or e.g. ./bench hash workloads to
+ * run some of them. A number sets the largest size of the workloads, e.g.
+ * ./bench workloads 100000000 (which needs about 16 GB of memory).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of key comparisons, counted by OAHT_KEY_EQUALS */
+static unsigned long key_compares;
+
+/* Results are stored here so that the lookups are not optimized away */
+static volatile int sink;
+
+/* FNV-1a */
+static inline unsigned int str_hash(const char *s) {
+	unsigned int h = 2166136261u;
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+static const char deleted_str[] = "";
+
+/* String keys, storing the hash */
+#define OAHT_PREFIX strtab
+#define OAHT_KEY_T const char *
+#define OAHT_VALUE_T int
+#define OAHT_HASH_T unsigned int
+#define OAHT_HASH(key) str_hash(key)
+#define OAHT_KEY_EQUALS(a, b) (key_compares++, strcmp(a, b) == 0)
+#define OAHT_EMPTY_KEY NULL
+#define OAHT_EMPTY_KEY_BYTE 0
+#define OAHT_DELETED_KEY deleted_str
+#include "oaht.h"
+
+/* String keys, in small tables without hashing */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX strtab_small
+#define OAHT_SMALL_SIZE 16
+#include "oaht.h"
+#undef OAHT_SMALL_SIZE
+
+/* String keys, with identity check */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX strtab_id
+#define OAHT_KEY_IDENTICAL(a, b) (a == b)
+#include "oaht.h"
+#undef OAHT_KEY_IDENTICAL
+
+/* String keys, without stored hash */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX strtab_nohash
+#define OAHT_NO_STORE_HASH
+#include "oaht.h"
+#undef OAHT_NO_STORE_HASH
+
+/* Integer keys, with a multiplicative hash */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_KEY_T
+#undef OAHT_HASH
+#undef OAHT_KEY_EQUALS
+#undef OAHT_EMPTY_KEY
+#undef OAHT_DELETED_KEY
+#define OAHT_PREFIX inttab
+#define OAHT_KEY_T unsigned int
+#define OAHT_HASH(key) ((key) * 2654435761u)
+#define OAHT_KEY_EQUALS(a, b) ((a) == (b))
+#define OAHT_EMPTY_KEY 0
+#define OAHT_DELETED_KEY 0xffffffffu
+#include "oaht.h"
+
+/* Integer keys with 64-byte values, stored with the keys or apart */
+struct big_value {
+	int x[16];
+};
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX bigtab
+#define OAHT_VALUE_T struct big_value
+#include "oaht.h"
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX bigtab_soa
+#define OAHT_SOA
+#include "oaht.h"
+#undef OAHT_SOA
+
+/* Integer keys, with parallel resize */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX partab
+#define OAHT_VALUE_T int
+#define OAHT_PARALLEL_RESIZE
+#include "oaht.h"
+#undef OAHT_PARALLEL_RESIZE
+
+/* Integer keys, saved to and mapped from a file */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX maptab
+#define OAHT_MMAP
+#include "oaht.h"
+#undef OAHT_MMAP
+
+/* Integer keys, allocated using the pool */
+#include "oaht_pool.h"
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+#define OAHT_PREFIX pooltab
+#define OAHT_ALLOC(size) oaht_pool_alloc(size)
+#define OAHT_REALLOC(ptr, size, oldsize) \
+	oaht_pool_realloc(ptr, size, oldsize)
+#define OAHT_FREE(ptr, size) oaht_pool_free(ptr, size)
+#include "oaht.h"
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+
+/* Integer keys, with control bytes */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX cbtab
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+
+/* Integer keys, hashed by the identity and by the functions of oaht_hash.h */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_HASH
+#define OAHT_PREFIX idtab
+#define OAHT_HASH(key) (key)
+#include "oaht.h"
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX fntab
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32(key, seed)
+#include "oaht.h"
+#undef OAHT_HASH_FN
+
+#ifdef OAHT_HASH_HAVE_CRC32C
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX crctab
+#define OAHT_HASH_FN(key, seed) oaht_hash_crc32c_u64(key, seed)
+#include "oaht.h"
+#undef OAHT_HASH_FN
+#endif
+
+/* Integer keys hashed by the identity, with counters */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX stattab
+#define OAHT_STATS
+#include "oaht.h"
+#undef OAHT_STATS
+
+/* Integer keys, in tables allocated using huge pages */
+#include "oaht_huge.h"
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+#define OAHT_PREFIX hugetab
+#define OAHT_ALLOC(size) oaht_huge_alloc(size)
+#define OAHT_REALLOC(ptr, size, oldsize) oaht_huge_realloc(ptr, size, oldsize)
+#define OAHT_FREE(ptr, size) oaht_huge_free(ptr, size)
+#include "oaht.h"
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+
+/* Integer keys, in tables with snapshots */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX snaptab
+#define OAHT_SNAPSHOT
+#include "oaht.h"
+#undef OAHT_SNAPSHOT
+
+/* Sets of integer keys with a seeded hash, stored or only in control bytes */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX intset
+#define OAHT_NO_VALUE
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32(key, seed)
+#define OAHT_PARALLEL_RESIZE
+#include "oaht.h"
+#undef OAHT_PARALLEL_RESIZE
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX intset_fp
+#define OAHT_NO_STORE_HASH
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+#undef OAHT_NO_STORE_HASH
+
+/* The same keys in a cuckoo set */
+#define OAHT_CUCKOO_PREFIX cuckooset
+#include "oaht_cuckoo.h"
+#undef OAHT_HASH_FN
+#undef OAHT_NO_VALUE
+
+/* 64-bit integer keys with a seeded hash, for the workloads */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_KEY_T
+#undef OAHT_HASH_T
+#undef OAHT_EMPTY_KEY
+#undef OAHT_DELETED_KEY
+#define OAHT_PREFIX wltab
+#define OAHT_KEY_T unsigned long long
+#define OAHT_HASH_T unsigned long long
+#define OAHT_HASH_FN(key, seed) oaht_hash_u64(key, seed)
+#define OAHT_EMPTY_KEY 0
+#define OAHT_DELETED_KEY ~0ULL
+#include "oaht.h"
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX wltab_inc
+#define OAHT_INCREMENTAL_RESIZE
+#include "oaht.h"
+#undef OAHT_INCREMENTAL_RESIZE
+#undef OAHT_HASH_FN
+
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define BENCH_TSC() __rdtsc()
+#endif
+
+/* Wall clock time, for the benchmarks using threads */
+static double wall_seconds(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static double seconds(void) {
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+/* Allocates n distinct strings with a common prefix */
+static char **make_strings(int n, const char *prefix) {
+	char **keys = malloc(n * sizeof(char *));
+	int i;
+	for (i = 0; i < n; i++) {
+		keys[i] = malloc(strlen(prefix) + 12);
+		sprintf(keys[i], "%s%d", prefix, i);
+	}
+	return keys;
+}
+
+static void free_strings(char **keys, int n) {
+	int i;
+	for (i = 0; i < n; i++)
+		free(keys[i]);
+	free(keys);
+}
+
+/*
+ * Key comparisons per lookup, for hits using the same pointers as inserted
+ * (identical), hits using copies and misses.
+ */
+#define BENCH_COMPARES(prefix, name, n)                                       \
+	do {                                                                  \
+		char **keys = make_strings(n, "some/common/prefix/");         \
+		char **copies = make_strings(n, "some/common/prefix/");       \
+		char **misses = make_strings(n, "some/other/prefix/");        \
+		struct prefix *t = prefix##_create();                         \
+		double t0, t1, t2;                                            \
+		unsigned long c0, c1, c2;                                     \
+		int i, sum = 0;                                               \
+		for (i = 0; i < n; i++)                                       \
+			t = prefix##_set(t, keys[i], i);                      \
+		c0 = key_compares;                                            \
+		t0 = seconds();                                               \
+		for (i = 0; i < n; i++)                                       \
+			sum += prefix##_get(t, keys[i], 0);                   \
+		c1 = key_compares;                                            \
+		t1 = seconds();                                               \
+		for (i = 0; i < n; i++)                                       \
+			sum += prefix##_get(t, copies[i], 0);                 \
+		c2 = key_compares;                                            \
+		t2 = seconds();                                               \
+		for (i = 0; i < n; i++)                                       \
+			sum += prefix##_get(t, misses[i], 0);                 \
+		sink = sum;                                                   \
+		printf("%-14s %8d %9.3f %9.3f %9.3f %8.1f %8.1f %8.1f\n",     \
+		       name, n,                                               \
+		       (double)(c1 - c0) / n, (double)(c2 - c1) / n,          \
+		       (double)(key_compares - c2) / n,                       \
+		       1e9 * (t1 - t0) / n, 1e9 * (t2 - t1) / n,              \
+		       1e9 * (seconds() - t2) / n);                           \
+		prefix##_destroy(t);                                          \
+		free_strings(keys, n);                                        \
+		free_strings(copies, n);                                      \
+		free_strings(misses, n);                                      \
+	} while (0)
+
+static void bench_compares(void) {
+	int n;
+	printf("%-14s %8s %9s %9s %9s %8s %8s %8s\n", "table", "n",
+	       "cmp/same", "cmp/copy", "cmp/miss",
+	       "ns/same", "ns/copy", "ns/miss");
+	for (n = 1000; n <= 1000000; n *= 10) {
+		BENCH_COMPARES(strtab, "hash", n);
+		BENCH_COMPARES(strtab_id, "hash+identity", n);
+		BENCH_COMPARES(strtab_nohash, "no hash", n);
+	}
+}
+
+/* A simple xorshift random number generator, never returning 0 */
+static unsigned int rng_state = 1;
+static unsigned int rng(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/*
+ * Random lookups, half hits and half misses, using get for each key compared
+ * to get_many for batches of 1000 keys.
+ */
+static void bench_get_many(void) {
+	unsigned int n, i, batch = 1000, nlookups = 4000000;
+	printf("\n%-10s %10s %10s %10s %8s\n", "n", "ns/get", "ns/many",
+	       "ns/cmany", "speedup");
+	for (n = 1000; n <= 16000000; n *= 4) {
+		unsigned int *keys = malloc(n * sizeof(unsigned int));
+		unsigned int *lookups = malloc(nlookups * sizeof(unsigned int));
+		int *values = malloc(batch * sizeof(int));
+		int *found = malloc(batch * sizeof(int));
+		struct inttab *t = inttab_create();
+		double t0, t1, t2, t3;
+		int sum = 0;
+		for (i = 0; i < n; i++) {
+			keys[i] = rng() & ~1u; /* even keys are inserted */
+			t = inttab_set(t, keys[i], (int)i);
+		}
+		for (i = 0; i < nlookups; i++)
+			lookups[i] = i % 2 ? keys[rng() % n] : rng() | 1;
+		t0 = seconds();
+		for (i = 0; i < nlookups; i++)
+			sum += inttab_get(t, lookups[i], 0);
+		t1 = seconds();
+		for (i = 0; i < nlookups; i += batch) {
+			inttab_get_many(t, lookups + i, batch, values, 0);
+			sum += values[0];
+		}
+		t2 = seconds();
+		for (i = 0; i < nlookups; i += batch)
+			sum += inttab_contains_many(t, lookups + i, batch, found);
+		t3 = seconds();
+		sink = sum;
+		printf("%-10u %10.1f %10.1f %10.1f %7.2fx\n", n,
+		       1e9 * (t1 - t0) / nlookups, 1e9 * (t2 - t1) / nlookups,
+		       1e9 * (t3 - t2) / nlookups, (t1 - t0) / (t2 - t1));
+		inttab_destroy(t);
+		free(keys);
+		free(lookups);
+		free(values);
+		free(found);
+	}
+}
+
+/*
+ * Random lookups, half hits and half misses, in tables with large values.
+ * With OAHT_SOA, the probes only touch the keys and the hit reads one value.
+ */
+#define BENCH_BIG(prefix, n, lookups, nlookups, t_contains, t_get)           \
+	do {                                                                  \
+		struct prefix *t = prefix##_create();                         \
+		struct big_value v, none;                                     \
+		double t0, t1;                                                \
+		int sum = 0;                                                  \
+		memset(&v, 0, sizeof(v));                                     \
+		memset(&none, 0, sizeof(none));                               \
+		for (i = 0; i < n; i++) {                                     \
+			v.x[0] = (int)i;                                      \
+			t = prefix##_set(t, keys[i], v);                      \
+		}                                                             \
+		t0 = seconds();                                               \
+		for (i = 0; i < nlookups; i++)                                \
+			sum += prefix##_contains(t, lookups[i]);              \
+		t1 = seconds();                                               \
+		for (i = 0; i < nlookups; i++)                                \
+			sum += prefix##_get(t, lookups[i], none).x[0];        \
+		t_get = 1e9 * (seconds() - t1) / nlookups;                    \
+		t_contains = 1e9 * (t1 - t0) / nlookups;                      \
+		sink = sum;                                                   \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+static void bench_soa(void) {
+	unsigned int n, i, nlookups = 4000000;
+	printf("\n%-10s %10s %10s %10s %10s\n", "n", "ns/cont", "ns/get",
+	       "soa/cont", "soa/get");
+	for (n = 1000; n <= 4000000; n *= 4) {
+		unsigned int *keys = malloc(n * sizeof(unsigned int));
+		unsigned int *lookups = malloc(nlookups * sizeof(unsigned int));
+		double c0, g0, c1, g1;
+		for (i = 0; i < n; i++)
+			keys[i] = rng() & ~1u;
+		for (i = 0; i < nlookups; i++)
+			lookups[i] = i % 2 ? keys[rng() % n] : rng() | 1;
+		BENCH_BIG(bigtab, n, lookups, nlookups, c0, g0);
+		BENCH_BIG(bigtab_soa, n, lookups, nlookups, c1, g1);
+		printf("%-10u %10.1f %10.1f %10.1f %10.1f\n", n, c0, g0, c1, g1);
+		free(keys);
+		free(lookups);
+	}
+}
+
+/* Growing a large table 4 times using _resize_parallel with 1 to 8 threads */
+static void bench_resize_parallel(void) {
+	unsigned int n = 16000000, i, threads;
+	printf("\n%-10s %10s %10s\n", "threads", "ms/resize", "speedup");
+	for (threads = 1; threads <= 8; threads *= 2) {
+		struct partab *t = partab_create_presized(n + n / 2);
+		double t0, t1;
+		static double base;
+		rng_state = 1;
+		for (i = 0; i < n; i++)
+			t = partab_set(t, rng(), (int)i);
+		t0 = wall_seconds();
+		t = partab_resize_parallel(t, 4 * (t->mask + 1), threads);
+		t1 = wall_seconds();
+		if (threads == 1)
+			base = t1 - t0;
+		printf("%-10u %10.1f %9.2fx\n", threads, 1e3 * (t1 - t0),
+		       base / (t1 - t0));
+		sink = partab_len(t);
+		partab_destroy(t);
+	}
+}
+
+/*
+ * Many small tables created, filled with a few keys and destroyed in random
+ * order, using malloc (partab) and the pool (pooltab).
+ */
+#define BENCH_CHURN(prefix, tables, order, ntables, rounds, nkeys, ns)       \
+	do {                                                                  \
+		unsigned int r, i, j;                                         \
+		double t0 = seconds();                                        \
+		for (r = 0; r < rounds; r++) {                                \
+			for (i = 0; i < ntables; i++) {                       \
+				struct prefix *t = prefix##_create();         \
+				for (j = 1; j <= nkeys; j++)                  \
+					t = prefix##_set(t, j, (int)i);       \
+				tables[i] = t;                                \
+			}                                                     \
+			for (i = 0; i < ntables; i++)                         \
+				prefix##_destroy(                             \
+					(struct prefix *)tables[order[i]]);   \
+		}                                                             \
+		ns = 1e9 * (seconds() - t0) / ((double)rounds * ntables);     \
+	} while (0)
+
+static void bench_pool(void) {
+	unsigned int ntables = 1000000, rounds = 5, nkeys, i;
+	void **tables = malloc(ntables * sizeof(void *));
+	unsigned int *order = malloc(ntables * sizeof(unsigned int));
+	printf("\n%-10s %10s %10s %8s\n", "keys", "ns/malloc", "ns/pool",
+	       "speedup");
+	for (i = 0; i < ntables; i++)
+		order[i] = i;
+	for (i = ntables - 1; i > 0; i--) {
+		unsigned int j = rng() % (i + 1), tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+	for (nkeys = 1; nkeys <= 16; nkeys *= 4) {
+		double t_malloc, t_pool;
+		BENCH_CHURN(partab, tables, order, ntables, rounds, nkeys,
+		            t_malloc);
+		BENCH_CHURN(pooltab, tables, order, ntables, rounds, nkeys,
+		            t_pool);
+		printf("%-10u %10.1f %10.1f %7.2fx\n", nkeys, t_malloc, t_pool,
+		       t_malloc / t_pool);
+	}
+	oaht_pool_clear();
+	free(tables);
+	free(order);
+}
+
+/*
+ * Tables with a few HTTP header names as keys, created, looked up 4 times per
+ * key and destroyed, hashing the keys (strtab) and comparing them one by one
+ * (strtab_small).
+ */
+#define BENCH_SMALL(prefix, keys, ntables, nkeys, ns)                         \
+	do {                                                                  \
+		unsigned int i, j, r;                                         \
+		int sum = 0;                                                  \
+		double t0 = seconds();                                        \
+		for (i = 0; i < ntables; i++) {                               \
+			struct prefix *t = prefix##_create();                 \
+			for (j = 0; j < nkeys; j++)                           \
+				t = prefix##_set(t, keys[j], (int)j);         \
+			for (r = 0; r < 4; r++)                               \
+				for (j = 0; j < nkeys; j++)                   \
+					sum += prefix##_get(t, keys[j], 0);   \
+			prefix##_destroy(t);                                  \
+		}                                                             \
+		sink = sum;                                                   \
+		ns = 1e9 * (seconds() - t0) / ((double)ntables * nkeys * 5);  \
+	} while (0)
+
+static void bench_small(void) {
+	static const char *keys[15] = {
+		"host", "user-agent", "accept", "accept-language",
+		"accept-encoding", "connection", "cookie", "referer",
+		"content-type", "content-length", "cache-control", "origin",
+		"pragma", "authorization", "upgrade-insecure-requests"
+	};
+	unsigned int ntables = 200000, nkeys;
+	printf("\n%-10s %10s %10s %8s\n", "keys", "ns/hashed", "ns/small",
+	       "speedup");
+	for (nkeys = 1; nkeys <= 15; nkeys += 2) {
+		double t_hashed, t_small;
+		BENCH_SMALL(strtab, keys, ntables, nkeys, t_hashed);
+		BENCH_SMALL(strtab_small, keys, ntables, nkeys, t_small);
+		printf("%-10u %10.1f %10.1f %7.2fx\n", nkeys, t_hashed, t_small,
+		       t_hashed / t_small);
+	}
+}
+
+/*
+ * Building a table of n keys using set compared to mapping a saved copy of
+ * it, and the following random lookups, which load the mapped pages.
+ */
+static void bench_mmap(void) {
+	unsigned int n = 4000000, nlookups = 1000000, i;
+	char path[] = "/tmp/oaht_bench_XXXXXX";
+	int fd = mkstemp(path), sum = 0;
+	struct maptab *t = maptab_create(), *m;
+	double t0, t1, t2, t3, t4;
+	if (fd < 0) {
+		perror("mkstemp");
+		return;
+	}
+	rng_state = 1;
+	t0 = wall_seconds();
+	for (i = 0; i < n; i++)
+		t = maptab_set(t, rng(), (int)i);
+	t1 = wall_seconds();
+	if (maptab_save(t, fd) != 0)
+		perror("save");
+	close(fd);
+	t2 = wall_seconds();
+	m = maptab_open_mmap(path);
+	t3 = wall_seconds();
+	if (!m) {
+		perror("open_mmap");
+		unlink(path);
+		maptab_destroy(t);
+		return;
+	}
+	for (i = 0; i < nlookups; i++)
+		sum += maptab_get(m, rng(), 0);
+	t4 = wall_seconds();
+	sink = sum;
+	printf("\n%-10s %10s %10s %12s\n", "n", "ms/build", "ms/open",
+	       "ns/1st-get");
+	printf("%-10u %10.1f %10.3f %12.1f\n", n, 1e3 * (t1 - t0),
+	       1e3 * (t3 - t2), 1e9 * (t4 - t3) / nlookups);
+	maptab_close_mmap(m);
+	unlink(path);
+	maptab_destroy(t);
+}
+
+/* Returns the keys of a random sequence, with their positions as values */
+struct build_arg {
+	unsigned int i;
+};
+
+static int build_next(void *arg, unsigned int *key, int *value) {
+	struct build_arg *b = (struct build_arg *)arg;
+	*key = rng();
+	*value = (int)b->i++;
+	return 1;
+}
+
+/*
+ * Building a table of n random keys using set, using set after reserve and
+ * using _build_from.
+ */
+static void bench_build(void) {
+	unsigned int n, i;
+	printf("\n%-10s %10s %10s %10s %8s\n", "n", "ns/set", "ns/reserve",
+	       "ns/build", "speedup");
+	for (n = 1000000; n <= 16000000; n *= 4) {
+		struct inttab *t;
+		struct build_arg arg = {0};
+		double t0, d_set, d_reserve, d_build;
+		rng_state = 1;
+		t0 = wall_seconds();
+		t = inttab_create();
+		for (i = 0; i < n; i++)
+			t = inttab_set(t, rng(), (int)i);
+		d_set = wall_seconds() - t0;
+		inttab_destroy(t);
+		rng_state = 1;
+		t0 = wall_seconds();
+		t = inttab_reserve(inttab_create(), n);
+		for (i = 0; i < n; i++)
+			t = inttab_set(t, rng(), (int)i);
+		d_reserve = wall_seconds() - t0;
+		inttab_destroy(t);
+		rng_state = 1;
+		t0 = wall_seconds();
+		t = inttab_build_from(build_next, &arg, n);
+		d_build = wall_seconds() - t0;
+		sink = inttab_len(t);
+		inttab_destroy(t);
+		printf("%-10u %10.1f %10.1f %10.1f %7.2fx\n", n, 1e9 * d_set / n,
+		       1e9 * d_reserve / n, 1e9 * d_build / n, d_set / d_build);
+	}
+}
+
+/*
+ * Iterating over tables of 4M slots where a given part of the slots is used,
+ * using _iter, which tests each slot, and using _next of a table with control
+ * bytes, which skips the empty slots a group at a time.
+ */
+static void bench_iter(void) {
+	unsigned int slots = 1u << 22, den, i;
+	printf("\n%-10s %10s %10s %8s\n", "used", "ns/iter", "ns/next",
+	       "speedup");
+	for (den = 2; den <= 128; den *= 4) {
+		struct inttab *t = inttab_create_presized(slots);
+		struct cbtab *c = cbtab_create_presized(slots);
+		unsigned int n = slots / den, pos, k, sum = 0;
+		int v;
+		struct cbtab_entry *e;
+		double t0, d_iter, d_next;
+		rng_state = 1;
+		for (i = 0; i < n; i++) {
+			k = rng() | 1;
+			t = inttab_set(t, k, (int)i);
+			c = cbtab_set(c, k, (int)i);
+		}
+		t0 = wall_seconds();
+		for (pos = 0; (pos = inttab_iter(t, pos, &k, &v));)
+			sum += k;
+		d_iter = wall_seconds() - t0;
+		t0 = wall_seconds();
+		for (pos = 0; (e = cbtab_next(c, &pos));)
+			sum += e->key;
+		d_next = wall_seconds() - t0;
+		sink = (int)sum;
+		printf("1/%-8u %10.2f %10.2f %7.2fx\n", den,
+		       1e9 * d_iter / inttab_len(t), 1e9 * d_next / cbtab_len(c),
+		       d_iter / d_next);
+		inttab_destroy(t);
+		cbtab_destroy(c);
+	}
+}
+
+/*
+ * Inserting and looking up keys which are random, consecutive, multiples of
+ * 4096 and multiples of 65536, with the identity as the hash function and
+ * with the hash functions of oaht_hash.h. The identity uses only the low bits
+ * of the keys, so the multiples collide.
+ */
+#define BENCH_HASH(prefix, keys, n, ns)                                       \
+	do {                                                                  \
+		struct prefix *t = prefix##_create();                         \
+		unsigned int j;                                               \
+		int sum = 0;                                                  \
+		double t0 = wall_seconds();                                   \
+		for (j = 0; j < n; j++)                                       \
+			t = prefix##_set(t, keys[j], (int)j);                 \
+		for (j = 0; j < n; j++)                                       \
+			sum += prefix##_get(t, keys[j], 0);                   \
+		ns = 1e9 * (wall_seconds() - t0) / (2 * n);                   \
+		sink = sum;                                                   \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+static void bench_hash(void) {
+	static const char *names[] = {"random", "sequence", "4096*i", "65536*i"};
+	unsigned int n = 1u << 15, i, p;
+	unsigned int *keys = malloc(n * sizeof(unsigned int));
+	printf("\n%-10s %10s %10s %10s\n", "keys", "ns/ident", "ns/hash_u32",
+	       "ns/crc32c");
+	for (p = 0; p < 4; p++) {
+		double d_id, d_fn, d_crc = 0;
+		rng_state = 1;
+		for (i = 0; i < n; i++)
+			keys[i] = p == 0 ? rng() | 1 : p == 1 ? i + 1 :
+			          p == 2 ? (i + 1) << 12 : (i + 1) << 16;
+		BENCH_HASH(idtab, keys, n, d_id);
+		BENCH_HASH(fntab, keys, n, d_fn);
+		#ifdef OAHT_HASH_HAVE_CRC32C
+		BENCH_HASH(crctab, keys, n, d_crc);
+		#endif
+		printf("%-10s %10.1f %10.1f %10.1f\n", names[p], d_id, d_fn,
+		       d_crc);
+	}
+	free(keys);
+}
+
+/*
+ * The cost of the counters, and the statistics which show that the identity
+ * is a bad hash function for the multiples of 4096 and 65536.
+ */
+static void bench_stats(void) {
+	static const char *names[] = {"random", "sequence", "4096*i", "65536*i"};
+	unsigned int n = 1u << 15, i, p;
+	unsigned int *keys = malloc(n * sizeof(unsigned int));
+	printf("\n%-10s %10s %10s %10s %10s %10s %10s\n", "keys", "ns/ident",
+	       "ns/stats", "probes", "max_probes", "distance", "cluster");
+	for (p = 0; p < 4; p++) {
+		struct stattab_stats st;
+		struct stattab *t;
+		double d_id, d_st;
+		rng_state = 1;
+		for (i = 0; i < n; i++)
+			keys[i] = p == 0 ? rng() | 1 : p == 1 ? i + 1 :
+			          p == 2 ? (i + 1) << 12 : (i + 1) << 16;
+		BENCH_HASH(idtab, keys, n, d_id);
+		BENCH_HASH(stattab, keys, n, d_st);
+		t = stattab_create();
+		for (i = 0; i < n; i++)
+			t = stattab_set(t, keys[i], (int)i);
+		for (i = 0; i < n; i++)
+			sink = stattab_get(t, keys[i], 0);
+		stattab_stats(t, &st);
+		printf("%-10s %10.1f %10.1f %10.1f %10llu %10.1f %10lu\n",
+		       names[p], d_id, d_st,
+		       (double)st.counters.probes / st.counters.lookups,
+		       st.counters.max_probes, st.mean_distance,
+		       (unsigned long)st.max_cluster);
+		stattab_destroy(t);
+	}
+	free(keys);
+}
+
+/*
+ * Counting the occurrences of random keys out of n distinct keys, using get
+ * and set for each key compared to a single upsert.
+ */
+static void bench_upsert(void) {
+	unsigned int n, i, nops = 4000000;
+	unsigned int *ops = malloc(nops * sizeof(unsigned int));
+	printf("\n%-10s %10s %10s %8s\n", "n", "ns/get+set", "ns/upsert",
+	       "speedup");
+	for (n = 1000; n <= 5000000; n *= 8) {
+		struct inttab *t = inttab_create();
+		double t0, d_getset, d_upsert;
+		rng_state = 1;
+		for (i = 0; i < nops; i++)
+			ops[i] = 1 + rng() % n;
+		t0 = wall_seconds();
+		for (i = 0; i < nops; i++)
+			t = inttab_set(t, ops[i], inttab_get(t, ops[i], 0) + 1);
+		d_getset = wall_seconds() - t0;
+		inttab_destroy(t);
+		t = inttab_create();
+		t0 = wall_seconds();
+		for (i = 0; i < nops; i++)
+			(*inttab_upsert(&t, ops[i], NULL))++;
+		d_upsert = wall_seconds() - t0;
+		sink = inttab_get(t, ops[0], 0);
+		printf("%-10u %10.1f %10.1f %7.2fx\n", n,
+		       1e9 * d_getset / nops, 1e9 * d_upsert / nops,
+		       d_getset / d_upsert);
+		inttab_destroy(t);
+	}
+	free(ops);
+}
+
+/*
+ * Looking up string keys in 4 tables, hashing each key for each table using
+ * get compared to hashing it once using get_h.
+ */
+static void bench_hash_given(void) {
+	int n, i, j, ntables = 4;
+	unsigned int sum = 0;
+	printf("\n%-10s %10s %10s %8s\n", "n", "ns/get", "ns/get_h", "speedup");
+	for (n = 1000; n <= 1000000; n *= 10) {
+		char **keys = make_strings(n, "some/common/prefix/");
+		struct strtab *t[4];
+		double t0, d_get, d_get_h;
+		for (j = 0; j < ntables; j++) {
+			t[j] = strtab_create();
+			for (i = j; i < n; i += 2)
+				t[j] = strtab_set(t[j], keys[i], i);
+		}
+		t0 = wall_seconds();
+		for (i = 0; i < n; i++)
+			for (j = 0; j < ntables; j++)
+				sum += strtab_get(t[j], keys[i], 0);
+		d_get = wall_seconds() - t0;
+		t0 = wall_seconds();
+		for (i = 0; i < n; i++) {
+			unsigned int h = strtab_hash(t[0], keys[i]);
+			for (j = 0; j < ntables; j++)
+				sum += strtab_get_h(t[j], keys[i], h, 0);
+		}
+		d_get_h = wall_seconds() - t0;
+		sink = (int)sum;
+		printf("%-10d %10.1f %10.1f %7.2fx\n", n,
+		       1e9 * d_get / ((double)n * ntables),
+		       1e9 * d_get_h / ((double)n * ntables), d_get / d_get_h);
+		for (j = 0; j < ntables; j++)
+			strtab_destroy(t[j]);
+		free_strings(keys, n);
+	}
+}
+
+/*
+ * Random lookups, half hits and half misses, in tables allocated using malloc
+ * and using oaht_huge.h, which uses huge pages to reduce the TLB misses.
+ */
+#define BENCH_HUGE(prefix, n, lookups, nlookups, ns)                          \
+	do {                                                                  \
+		struct prefix *t = prefix##_create();                         \
+		unsigned int i;                                               \
+		unsigned int sum = 0;                                         \
+		double t0;                                                    \
+		rng_state = 1;                                                \
+		for (i = 0; i < n; i++)                                       \
+			t = prefix##_set(t, rng() | 1, (int)i);               \
+		t0 = wall_seconds();                                          \
+		for (i = 0; i < nlookups; i++)                                \
+			sum += prefix##_get(t, lookups[i], 0);                \
+		ns = 1e9 * (wall_seconds() - t0) / nlookups;                  \
+		sink = (int)sum;                                              \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+static void bench_huge(void) {
+	unsigned int n, i, nlookups = 4000000;
+	unsigned int *lookups = malloc(nlookups * sizeof(unsigned int));
+	printf("\n%-10s %10s %10s %8s\n", "n", "ns/malloc", "ns/huge",
+	       "speedup");
+	for (n = 1u << 16; n <= 1u << 25; n *= 8) {
+		double d_malloc, d_huge;
+		/* the keys as inserted, or with the low bit cleared to miss */
+		rng_state = 1;
+		for (i = 0; i < nlookups; i++) {
+			unsigned int k = rng();
+			lookups[i] = i % 2 ? k | 1 : k & ~1u;
+			if (i % n == n - 1)
+				rng_state = 1;
+		}
+		BENCH_HUGE(inttab, n, lookups, nlookups, d_malloc);
+		BENCH_HUGE(hugetab, n, lookups, nlookups, d_huge);
+		printf("%-10u %10.1f %10.1f %7.2fx\n", n, d_malloc, d_huge,
+		       d_malloc / d_huge);
+	}
+	free(lookups);
+}
+
+/*
+ * Taking a copy of a table for a reader using clone compared to using
+ * snapshot, and the time of updating random keys without and with the
+ * snapshot, which copies the pages written to.
+ */
+static void bench_snapshot(void) {
+	unsigned int n, i;
+	printf("\n%-10s %8s %10s %10s %10s %11s %10s\n", "n", "updates",
+	       "ms/clone", "ms/snap", "ns/update", "ns/upd+snap", "copied");
+	for (n = 1000; n <= 8000000; n *= 8) {
+		unsigned int *keys = malloc(n * sizeof(unsigned int));
+		unsigned int nupdates = n / 1000 + 1;
+		struct snaptab *t = snaptab_create(), *c;
+		struct snaptab_snapshot *s;
+		double t0, d_clone, d_snap, d_update, d_update_snap;
+		size_t copied = 0;
+		rng_state = 1;
+		for (i = 0; i < n; i++) {
+			keys[i] = rng() | 1;
+			t = snaptab_set(t, keys[i], (int)i);
+		}
+		t0 = wall_seconds();
+		c = snaptab_clone(t);
+		d_clone = wall_seconds() - t0;
+		sink = (int)snaptab_len(c);
+		snaptab_destroy(c);
+		t0 = wall_seconds();
+		for (i = 0; i < nupdates; i++)
+			t = snaptab_set(t, keys[rng() % n], (int)i);
+		d_update = wall_seconds() - t0;
+		t0 = wall_seconds();
+		s = snaptab_snapshot(t);
+		d_snap = wall_seconds() - t0;
+		t0 = wall_seconds();
+		for (i = 0; i < nupdates; i++)
+			t = snaptab_set(t, keys[rng() % n], (int)i);
+		d_update_snap = wall_seconds() - t0;
+		for (i = 0; i <= s->mask / OAHT_SNAPSHOT_PAGE; i++)
+			if (s->pages[i])
+				copied += sizeof(struct snaptab_page);
+		sink = (int)snaptab_snapshot_len(s);
+		snaptab_snapshot_release(s);
+		printf("%-10u %8u %10.3f %10.3f %10.1f %11.1f %9.0f%%\n", n,
+		       nupdates, 1e3 * d_clone, 1e3 * d_snap,
+		       1e9 * d_update / nupdates, 1e9 * d_update_snap / nupdates,
+		       100.0 * copied / snaptab_sizeof(t->mask));
+		snaptab_destroy(t);
+		free(keys);
+	}
+}
+
+#define BENCH_FINGERPRINT(prefix, n, lookups, nlookups, bytes, ms, ns)       \
+	do {                                                                  \
+		struct prefix *t = prefix##_create();                         \
+		unsigned int i;                                               \
+		unsigned int hits = 0;                                        \
+		double t0 = wall_seconds();                                   \
+		rng_state = 1;                                                \
+		for (i = 0; i < n; i++)                                       \
+			t = prefix##_add(t, rng() | 1);                       \
+		ms = 1e3 * (wall_seconds() - t0);                             \
+		bytes = (double)prefix##_sizeof(t->mask) / (t->mask + 1);     \
+		t0 = wall_seconds();                                          \
+		for (i = 0; i < nlookups; i++)                                \
+			hits += prefix##_contains(t, lookups[i]);             \
+		ns = 1e9 * (wall_seconds() - t0) / nlookups;                  \
+		sink = (int)hits;                                             \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+/*
+ * Sets of integer keys storing the full hash with each key compared to
+ * storing only 7 bits of it in the control bytes, which recomputes the hash
+ * when the table grows: the bytes per slot, the time to build the set and
+ * the time per lookup, half of them hits.
+ */
+static void bench_fingerprint(void) {
+	unsigned int n, i, nlookups = 4000000;
+	unsigned int *lookups = malloc(nlookups * sizeof(unsigned int));
+	printf("\n%-10s %8s %8s %10s %10s %10s %10s\n", "n", "B/hash",
+	       "B/fp", "ms/hash", "ms/fp", "ns/hash", "ns/fp");
+	for (n = 1u << 16; n <= 1u << 25; n *= 8) {
+		double b_hash, b_fp, ms_hash, ms_fp, ns_hash, ns_fp;
+		rng_state = 1;
+		for (i = 0; i < nlookups; i++) {
+			unsigned int k = rng();
+			lookups[i] = i % 2 ? k | 1 : k & ~1u;
+			if (i % n == n - 1)
+				rng_state = 1;
+		}
+		BENCH_FINGERPRINT(intset, n, lookups, nlookups, b_hash, ms_hash,
+		                  ns_hash);
+		BENCH_FINGERPRINT(intset_fp, n, lookups, nlookups, b_fp, ms_fp,
+		                  ns_fp);
+		printf("%-10u %8.2f %8.2f %10.1f %10.1f %10.1f %10.1f\n", n,
+		       b_hash, b_fp, ms_hash, ms_fp, ns_hash, ns_fp);
+	}
+	free(lookups);
+}
+
+#define BENCH_CUCKOO(prefix, n, lookups, nlookups, bytes, ms, ns)            \
+	do {                                                                  \
+		struct prefix *t = prefix##_create();                         \
+		unsigned int i;                                               \
+		unsigned int hits = 0;                                        \
+		double t0 = wall_seconds();                                   \
+		rng_state = 1;                                                \
+		for (i = 0; i < n; i++)                                       \
+			t = prefix##_add(t, rng() | 1);                       \
+		ms = 1e3 * (wall_seconds() - t0);                             \
+		bytes = (double)prefix##_sizeof(t->mask) / n;                 \
+		t0 = wall_seconds();                                          \
+		for (i = 0; i < nlookups; i++)                                \
+			hits += prefix##_contains(t, lookups[i]);             \
+		ns = 1e9 * (wall_seconds() - t0) / nlookups;                  \
+		sink = (int)hits;                                             \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+/*
+ * Sets of integer keys using linear probing with control bytes compared to
+ * bucketized cuckoo hashing: the bytes per key, the time to build the set
+ * and the time per lookup, half of them hits. The sizes are chosen so that
+ * the cuckoo set is almost full and the other one is half full or more.
+ */
+static void bench_cuckoo(void) {
+	unsigned int n, i, nlookups = 4000000;
+	unsigned int *lookups = malloc(nlookups * sizeof(unsigned int));
+	printf("\n%-10s %8s %8s %10s %10s %10s %10s\n", "n", "B/fp", "B/cuckoo",
+	       "ms/fp", "ms/cuckoo", "ns/fp", "ns/cuckoo");
+	for (n = 62000; n <= 32000000; n = n * 8 - n / 4) {
+		double b_fp, b_ck, ms_fp, ms_ck, ns_fp, ns_ck;
+		rng_state = 1;
+		for (i = 0; i < nlookups; i++) {
+			unsigned int k = rng();
+			lookups[i] = i % 2 ? k | 1 : k & ~1u;
+			if (i % n == n - 1)
+				rng_state = 1;
+		}
+		BENCH_CUCKOO(intset_fp, n, lookups, nlookups, b_fp, ms_fp, ns_fp);
+		BENCH_CUCKOO(cuckooset, n, lookups, nlookups, b_ck, ms_ck, ns_ck);
+		printf("%-10u %8.2f %8.2f %10.1f %10.1f %10.1f %10.1f\n", n,
+		       b_fp, b_ck, ms_fp, ms_ck, ns_fp, ns_ck);
+	}
+	free(lookups);
+}
+
+/* Building a set of the keys of a which are (or aren't) in b by hand */
+#define BENCH_SET_LOOP(a, b, in, ms)                                         \
+	do {                                                                  \
+		struct intset *r = intset_create();                           \
+		unsigned int pos = 0, k;                                      \
+		double t0 = wall_seconds();                                   \
+		while ((pos = intset_iter(a, pos, &k, NULL)))                 \
+			if (intset_contains(b, k) == in)                      \
+				r = intset_add(r, k);                         \
+		ms = 1e3 * (wall_seconds() - t0);                             \
+		sink = intset_len(r);                                         \
+		intset_destroy(r);                                            \
+	} while (0)
+
+#define BENCH_SET_OP(expr, ms)                                                \
+	do {                                                                  \
+		struct intset *r;                                             \
+		double t0 = wall_seconds();                                   \
+		r = expr;                                                     \
+		ms = 1e3 * (wall_seconds() - t0);                             \
+		sink = intset_len(r);                                         \
+		intset_destroy(r);                                            \
+	} while (0)
+
+/*
+ * The intersection and difference of two sets of n random keys, half of them
+ * in both, using a loop of _iter, _contains and _add compared to _intersect
+ * and _difference and their parallel versions with 4 threads.
+ */
+static void bench_set_ops(void) {
+	unsigned int n, i;
+	printf("\n%-10s %-10s %10s %10s %10s\n", "n", "op", "ms/loop", "ms/op",
+	       "ms/4 thr");
+	for (n = 10000; n <= 10000000; n *= 10) {
+		struct intset *a = intset_create(), *b = intset_create();
+		double loop, op, par;
+		rng_state = 1;
+		for (i = 0; i < n; i++) {
+			unsigned int k = rng();
+			a = intset_add(a, k);
+			b = intset_add(b, i % 2 ? k : rng());
+		}
+		BENCH_SET_LOOP(a, b, 1, loop);
+		BENCH_SET_OP(intset_intersect(a, b), op);
+		BENCH_SET_OP(intset_intersect_parallel(a, b, 4), par);
+		printf("%-10u %-10s %10.1f %10.1f %10.1f\n", n, "intersect",
+		       loop, op, par);
+		BENCH_SET_LOOP(a, b, 0, loop);
+		BENCH_SET_OP(intset_difference(a, b), op);
+		BENCH_SET_OP(intset_difference_parallel(a, b, 4), par);
+		printf("%-10u %-10s %10.1f %10.1f %10.1f\n", n, "difference",
+		       loop, op, par);
+		intset_destroy(a);
+		intset_destroy(b);
+	}
+}
+
+/* Sums the values for _for_each_parallel */
+static void sum_values(void *arg, unsigned int const *key, int *value) {
+	(void)key;
+	*(long long *)arg += *value;
+}
+
+/* Keeps the odd values for _retain */
+static int keep_odd(void *arg, unsigned int const *key, int *value) {
+	(void)arg;
+	(void)key;
+	return *value & 1;
+}
+
+/*
+ * Summing the values of a large table and deleting half of its entries,
+ * using _iter and delete compared to _for_each_parallel and _retain_parallel
+ * with 1 to 8 threads.
+ */
+static void bench_for_each(void) {
+	unsigned int n = 16000000, i, k = 0, threads, pos;
+	long long sums[8], sum;
+	void *args[8];
+	int v;
+	struct partab *t = partab_create_presized(n + n / 2);
+	unsigned int *deleted = malloc(n / 2 * sizeof(unsigned int));
+	double t0, ms_sum, ms_retain;
+	rng_state = 1;
+	for (i = 0; i < n; i++)
+		t = partab_set(t, rng(), (int)i);
+	t0 = wall_seconds();
+	for (sum = 0, pos = 0; (pos = partab_iter(t, pos, &k, &v));)
+		sum += v;
+	ms_sum = 1e3 * (wall_seconds() - t0);
+	t0 = wall_seconds();
+	for (i = 0, pos = 0; (pos = partab_iter(t, pos, &k, &v));)
+		if (!(v & 1))
+			deleted[i++] = k;
+	while (i > 0)
+		t = partab_delete(t, deleted[--i]);
+	ms_retain = 1e3 * (wall_seconds() - t0);
+	sink = (int)sum + (int)partab_len(t);
+	partab_destroy(t);
+	printf("\n%-10s %10s %10s\n", "threads", "ms/sum", "ms/retain");
+	printf("%-10s %10.1f %10.1f\n", "iter", ms_sum, ms_retain);
+	for (threads = 1; threads <= 8; threads *= 2) {
+		t = partab_create_presized(n + n / 2);
+		rng_state = 1;
+		for (i = 0; i < n; i++)
+			t = partab_set(t, rng(), (int)i);
+		for (i = 0; i < 8; i++) {
+			sums[i] = 0;
+			args[i] = &sums[i];
+		}
+		t0 = wall_seconds();
+		partab_for_each_parallel(t, sum_values, args, threads);
+		for (sum = 0, i = 0; i < 8; i++)
+			sum += sums[i];
+		ms_sum = 1e3 * (wall_seconds() - t0);
+		t0 = wall_seconds();
+		t = partab_retain_parallel(t, keep_odd, args, threads);
+		ms_retain = 1e3 * (wall_seconds() - t0);
+		printf("%-10u %10.1f %10.1f\n", threads, ms_sum, ms_retain);
+		sink = (int)sum + (int)partab_len(t);
+		partab_destroy(t);
+	}
+	free(deleted);
+}
+
+/* The largest size of the workloads, set by a command line argument */
+static size_t workload_max = 1000000;
+
+/* The times of the operations of a workload, in seconds per operation */
+struct workload {
+	double insert, hit, miss, churn, iter, pause;
+	size_t bytes;
+};
+
+/* The splitmix64 finalizer, a bijection, so that distinct keys stay distinct */
+static unsigned long long scramble(unsigned long long x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/*
+ * Fills order with n indexes of keys, either a random permutation or samples
+ * of a Zipfian distribution with parameter 0.99 where index 0 is the most
+ * frequent, using the method of Gray et al. as in YCSB.
+ */
+static void make_order(unsigned int *order, size_t n, int zipf) {
+	size_t i;
+	if (zipf) {
+		double theta = 0.99, zetan = 0, zeta2, alpha, eta, u, uz;
+		for (i = 1; i <= n; i++)
+			zetan += 1 / pow((double)i, theta);
+		zeta2 = 1 + 1 / pow(2, theta);
+		alpha = 1 / (1 - theta);
+		eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+		for (i = 0; i < n; i++) {
+			u = rng() / 4294967296.0;
+			uz = u * zetan;
+			order[i] = uz < 1 ? 0 : uz < zeta2 ? 1 :
+				(unsigned int)(n * pow(eta * u - eta + 1, alpha));
+			if (order[i] >= n)
+				order[i] = (unsigned int)n - 1;
+		}
+	} else {
+		for (i = 0; i < n; i++)
+			order[i] = (unsigned int)i;
+		for (i = n - 1; i > 0; i--) {
+			unsigned int j = rng() % (i + 1), tmp = order[i];
+			order[i] = order[j];
+			order[j] = tmp;
+		}
+	}
+}
+
+/* Formats the keys as decimal strings, stored in *buf */
+static const char **make_key_strings(const unsigned long long *keys, size_t n,
+                                     char **buf) {
+	const char **strs = malloc(n * sizeof(char *));
+	size_t i;
+	*buf = malloc(n * 21);
+	for (i = 0; i < n; i++) {
+		sprintf(*buf + 21 * i, "%llu", keys[i]);
+		strs[i] = *buf + 21 * i;
+	}
+	return strs;
+}
+
+/*
+ * Runs the operations of a workload on n keys, each of them reps times or
+ * more, so that the short ones can be timed: inserting the keys into a new
+ * table, the longest time of one insert (the resize pause), looking up the
+ * keys in the given order (hits) and the misses in the same order, deleting a
+ * key and inserting a miss (churn) and iterating over the entries using next.
+ */
+#define BENCH_WORKLOAD(prefix, keys, misses, order, n, reps, w)              \
+	do {                                                                  \
+		struct prefix *t;                                             \
+		struct prefix##_entry *e;                                     \
+		size_t i, rep;                                                \
+		OAHT_SIZE_T pos;                                              \
+		double t0, op;                                                \
+		unsigned int sum = 0;                                         \
+		t0 = wall_seconds();                                          \
+		for (rep = 0; rep < reps; rep++) {                            \
+			t = prefix##_create();                                \
+			for (i = 0; i < n; i++)                               \
+				t = prefix##_set(t, keys[i], (int)i);         \
+			prefix##_destroy(t);                                  \
+		}                                                             \
+		(w).insert = (wall_seconds() - t0) / (reps * n);              \
+		t = prefix##_create();                                        \
+		(w).pause = 0;                                                \
+		for (i = 0; i < n; i++) {                                     \
+			t0 = wall_seconds();                                  \
+			t = prefix##_set(t, keys[i], (int)i);                 \
+			op = wall_seconds() - t0;                             \
+			if (op > (w).pause)                                   \
+				(w).pause = op;                               \
+		}                                                             \
+		(w).bytes = prefix##_sizeof(t->mask);                         \
+		t0 = wall_seconds();                                          \
+		for (rep = 0; rep < reps; rep++)                              \
+			for (i = 0; i < n; i++)                               \
+				sum += prefix##_get(t, keys[order[i]], 0);    \
+		(w).hit = (wall_seconds() - t0) / (reps * n);                 \
+		t0 = wall_seconds();                                          \
+		for (rep = 0; rep < reps; rep++)                              \
+			for (i = 0; i < n; i++)                               \
+				sum += prefix##_get(t, misses[order[i]], 0);  \
+		(w).miss = (wall_seconds() - t0) / (reps * n);                \
+		t0 = wall_seconds();                                          \
+		for (rep = 0; rep < reps; rep++)                              \
+			for (pos = 0; (e = prefix##_next(t, &pos));)          \
+				sum += *prefix##_entry_value(t, e);           \
+		(w).iter = (wall_seconds() - t0) / (reps * prefix##_len(t));  \
+		/* the keys and the misses swap places in every other rep */  \
+		t0 = wall_seconds();                                          \
+		for (rep = 0; rep < reps; rep++) {                            \
+			for (i = 0; i < n; i++) {                             \
+				size_t j = order[i];                          \
+				t = prefix##_delete(t, rep % 2 ? misses[j]    \
+				                                : keys[j]);   \
+				t = prefix##_set(t, rep % 2 ? keys[j]         \
+				                            : misses[j], 1);  \
+			}                                                     \
+		}                                                             \
+		(w).churn = (wall_seconds() - t0) / (2 * reps * n);           \
+		sink = (int)sum;                                              \
+		prefix##_destroy(t);                                          \
+	} while (0)
+
+static void print_workload(const char *dist, size_t n, struct workload *w) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%-10s %10lu %8.1f %8.1f %8.1f %8.1f %8.1f %9.3f %8.1f %8.0f\n",
+	       dist, (unsigned long)n, 1e9 * w->insert, 1e9 * w->hit,
+	       1e9 * w->miss, 1e9 * w->churn, 1e9 * w->iter, 1e3 * w->pause,
+	       (double)w->bytes / n, ru.ru_maxrss / 1024.0);
+}
+
+/* The workload of string keys, formatted from the integer keys */
+static void bench_string_workload(const unsigned long long *ikeys,
+                                  const unsigned long long *imisses,
+                                  const unsigned int *order, size_t n,
+                                  size_t reps, struct workload *w) {
+	char *kbuf, *mbuf;
+	const char **keys = make_key_strings(ikeys, n, &kbuf);
+	const char **misses = make_key_strings(imisses, n, &mbuf);
+	BENCH_WORKLOAD(strtab, keys, misses, order, n, reps, *w);
+	free(keys);
+	free(misses);
+	free(kbuf);
+	free(mbuf);
+}
+
+/*
+ * Realistic workloads: inserts, hits, misses, delete churn, iteration and the
+ * longest resize pause, for 1K keys and every power of 10 up to workload_max,
+ * with keys which are uniformly random, sequential and multiples of 4096 and
+ * with Zipfian lookups of random keys. The tables have 64-bit integer keys
+ * hashed by oaht_hash_u64, with and without OAHT_INCREMENTAL_RESIZE, and
+ * string keys hashed by FNV-1a. The TSC rate, if there is one, converts the
+ * times to cycles. The RSS is the peak of the process so far.
+ */
+static void bench_workloads(void) {
+	static const char *names[] = {"uniform", "sequence", "4096*i", "zipf"};
+	unsigned long long *keys, *misses;
+	unsigned int *order;
+	size_t n, i;
+	int p, c;
+	#ifdef BENCH_TSC
+	double t0 = wall_seconds();
+	unsigned long long c0 = BENCH_TSC();
+	while (wall_seconds() - t0 < 0.1)
+		;
+	printf("\ncycles/op = ns/op * %.3f (TSC)\n",
+	       (BENCH_TSC() - c0) / (1e9 * (wall_seconds() - t0)));
+	#endif
+	for (c = 0; c < 3; c++) {
+		printf("\n%s\n", c == 0 ? "64-bit keys, oaht_hash_u64" :
+		       c == 1 ? "64-bit keys, oaht_hash_u64, incremental resize" :
+		       "string keys, FNV-1a");
+		printf("%-10s %10s %8s %8s %8s %8s %8s %9s %8s %8s\n", "keys",
+		       "n", "insert", "hit", "miss", "churn", "iter",
+		       "pause ms", "bytes/n", "RSS MB");
+		for (p = 0; p < 4; p++) {
+			for (n = 1000; n <= workload_max; n *= 10) {
+				size_t reps = n < 1000000 ? 1000000 / n : 1;
+				struct workload w;
+				keys = malloc(n * sizeof(*keys));
+				misses = malloc(n * sizeof(*misses));
+				order = malloc(n * sizeof(*order));
+				rng_state = 1;
+				for (i = 0; i < n; i++) {
+					keys[i] = p == 1 ? i + 1 :
+					          p == 2 ? (i + 1) << 12 :
+					          scramble(i + 1);
+					misses[i] = p == 1 ? n + i + 1 :
+					            p == 2 ? (n + i + 1) << 12 :
+					            scramble(n + i + 1);
+				}
+				make_order(order, n, p == 3);
+				if (c == 0)
+					BENCH_WORKLOAD(wltab, keys, misses, order,
+					               n, reps, w);
+				else if (c == 1)
+					BENCH_WORKLOAD(wltab_inc, keys, misses,
+					               order, n, reps, w);
+				else
+					bench_string_workload(keys, misses,
+					                      order, n, reps, &w);
+				print_workload(names[p], n, &w);
+				free(keys);
+				free(misses);
+				free(order);
+			}
+		}
+	}
+}
+
+/* The benchmarks, which are run in this order or as named on the command line */
+static const struct {
+	const char *name;
+	void (*fn)(void);
+} benches[] = {
+	{"compares", bench_compares},
+	{"get_many", bench_get_many},
+	{"soa", bench_soa},
+	{"resize_parallel", bench_resize_parallel},
+	{"pool", bench_pool},
+	{"small", bench_small},
+	{"mmap", bench_mmap},
+	{"build", bench_build},
+	{"iter", bench_iter},
+	{"hash", bench_hash},
+	{"stats", bench_stats},
+	{"upsert", bench_upsert},
+	{"hash_given", bench_hash_given},
+	{"huge", bench_huge},
+	{"snapshot", bench_snapshot},
+	{"fingerprint", bench_fingerprint},
+	{"cuckoo", bench_cuckoo},
+	{"set_ops", bench_set_ops},
+	{"for_each", bench_for_each},
+	{"workloads", bench_workloads},
+};
+
+/*
+ * Runs the benchmarks named by the arguments, or all of them. A number sets
+ * the largest size of the workloads, e.g. ./bench workloads 100000000.
+ */
+int main(int argc, char **argv) {
+	size_t i;
+	int arg, named = 0;
+	for (arg = 1; arg < argc; arg++)
+		if (argv[arg][0] >= '0' && argv[arg][0] <= '9')
+			workload_max = strtoul(argv[arg], NULL, 10);
+	for (arg = 1; arg < argc; arg++) {
+		if (argv[arg][0] >= '0' && argv[arg][0] <= '9')
+			continue;
+		named = 1;
+		for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+			if (strcmp(argv[arg], benches[i].name) == 0)
+				break;
+		if (i == sizeof(benches) / sizeof(benches[0])) {
+			fprintf(stderr, "unknown benchmark %s\n", argv[arg]);
+			return 1;
+		}
+		benches[i].fn();
+	}
+	if (!named)
+		for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+			benches[i].fn();
+	return 0;
+}
@@ -51,6 +51,254 @@
 	#define OAHT_OOM() exit(-1)
 #endif
 
+/*
+ * Incremental resize. If OAHT_INCREMENTAL_RESIZE is defined, a resize only
+ * allocates the new table. The entries are then moved from the old table a few
+ * slots at a time by each following operation, so that no single operation
+ * needs to rehash the whole table. OAHT_INCREMENTAL_STEP is the number of old
+ * slots to migrate per operation.
+ */
+#ifndef OAHT_INCREMENTAL_STEP
+	#define OAHT_INCREMENTAL_STEP 32
+#endif
+
+/*
+ * Load factor and growth. The table is resized when at least
+ * OAHT_MAX_LOAD_NUM / OAHT_MAX_LOAD_DEN of the slots are used or DELETED. It
+ * then grows to at least OAHT_GROWTH_FACTOR(used) times the number of used
+ * slots, rounded up to a power of two. The load factor must be less than 1.
+ */
+#ifndef OAHT_MAX_LOAD_NUM
+	#define OAHT_MAX_LOAD_NUM 2
+	#define OAHT_MAX_LOAD_DEN 3
+#endif
+#if OAHT_MAX_LOAD_NUM >= OAHT_MAX_LOAD_DEN || OAHT_MAX_LOAD_NUM <= 0
+	#error "OAHT_MAX_LOAD_NUM / OAHT_MAX_LOAD_DEN must be within (0, 1)"
+#endif
+#ifndef OAHT_GROWTH_FACTOR
+	#define OAHT_GROWTH_FACTOR(used) ((used) > 50000 ? 2 : 4)
+#endif
+
+/*
+ * Compaction and shrinking on delete. When a delete leaves at least
+ * OAHT_MAX_DELETED_NUM / OAHT_MAX_DELETED_DEN of the slots DELETED, the table
+ * is rehashed in place to turn them into EMPTY slots. When less than
+ * OAHT_MIN_LOAD_NUM / OAHT_MIN_LOAD_DEN of the slots are used, the table is
+ * shrunk. Define OAHT_MIN_LOAD_NUM to 0 to never shrink on delete.
+ */
+#ifndef OAHT_MAX_DELETED_NUM
+	#define OAHT_MAX_DELETED_NUM 1
+	#define OAHT_MAX_DELETED_DEN 4
+#endif
+#ifndef OAHT_MIN_LOAD_NUM
+	#define OAHT_MIN_LOAD_NUM 1
+	#define OAHT_MIN_LOAD_DEN 8
+#endif
+
+/*
+ * Control bytes. If OAHT_CONTROL_BYTES is defined, a separate array of one
+ * byte per slot is stored after the entries, holding 7 bits of the hash of
+ * a used slot or a special value for an EMPTY or DELETED slot. Lookups scan
+ * groups of control bytes using SIMD instructions if available (SSE2, AVX2 or
+ * NEON) and only touch the entries where the control byte matches. The
+ * probing is still linear, so the placement of the entries is unaffected.
+ */
+#if defined(OAHT_CONTROL_BYTES) && !defined(OAHT_GROUP_WIDTH)
+	#define OAHT_CTRL_EMPTY   0x80
+	#define OAHT_CTRL_DELETED 0xfe
+	/* 7 bits of the hash; not the low bits, which are used for the probing */
+	#define OAHT_CTRL_H2(hash) \
+		(unsigned char)(((unsigned long long)(hash) * 0x9e3779b97f4a7c15ULL) >> 57)
+	#if defined(__AVX2__)
+		#include <immintrin.h>
+		#define OAHT_GROUP_WIDTH 32
+		#define OAHT_GROUP_SHIFT 0
+	#elif defined(__SSE2__) || defined(_M_X64)
+		#include <emmintrin.h>
+		#define OAHT_GROUP_WIDTH 16
+		#define OAHT_GROUP_SHIFT 0
+	#elif defined(__ARM_NEON)
+		#include <arm_neon.h>
+		#define OAHT_GROUP_WIDTH 16
+		#define OAHT_GROUP_SHIFT 2 /* 4 bits per control byte */
+	#else
+		#define OAHT_GROUP_WIDTH 8
+		#define OAHT_GROUP_SHIFT 0
+	#endif
+
+	/*
+	 * Returns a bit mask of the control bytes in p[0..OAHT_GROUP_WIDTH-1]
+	 * which are equal to c. Bit i << OAHT_GROUP_SHIFT is set if p[i] == c.
+	 */
+	static inline unsigned long long
+	oaht_group_match(const unsigned char *p, unsigned char c) {
+		#if defined(__AVX2__)
+		__m256i g = _mm256_loadu_si256((const __m256i *)p);
+		return (unsigned int)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(g, _mm256_set1_epi8((char)c)));
+		#elif defined(__SSE2__) || defined(_M_X64)
+		__m128i g = _mm_loadu_si128((const __m128i *)p);
+		return (unsigned int)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+		#elif defined(__ARM_NEON)
+		uint8x16_t eq = vceqq_u8(vld1q_u8(p), vdupq_n_u8(c));
+		uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+		return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+			0x8888888888888888ULL;
+		#else
+		unsigned long long m = 0;
+		int i;
+		for (i = 0; i < OAHT_GROUP_WIDTH; i++)
+			m |= (unsigned long long)(p[i] == c) << i;
+		return m;
+		#endif
+	}
+
+	/*
+	 * Returns a bit mask of the control bytes in p[0..OAHT_GROUP_WIDTH-1]
+	 * of used slots, like oaht_group_match. EMPTY and DELETED are the only
+	 * control bytes with the high bit set.
+	 */
+	static inline unsigned long long
+	oaht_group_used(const unsigned char *p) {
+		#if defined(__AVX2__)
+		__m256i g = _mm256_loadu_si256((const __m256i *)p);
+		return ~(unsigned int)_mm256_movemask_epi8(g) & 0xffffffffULL;
+		#elif defined(__SSE2__) || defined(_M_X64)
+		__m128i g = _mm_loadu_si128((const __m128i *)p);
+		return ~(unsigned int)_mm_movemask_epi8(g) & 0xffffULL;
+		#elif defined(__ARM_NEON)
+		uint8x16_t used = vcgeq_s8(vreinterpretq_s8_u8(vld1q_u8(p)),
+		                           vdupq_n_s8(0));
+		uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(used), 4);
+		return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+			0x8888888888888888ULL;
+		#else
+		unsigned long long m = 0;
+		int i;
+		for (i = 0; i < OAHT_GROUP_WIDTH; i++)
+			m |= (unsigned long long)!(p[i] & 0x80) << i;
+		return m;
+		#endif
+	}
+
+	/* The index of the lowest control byte in a non-zero group bit mask */
+	static inline unsigned int
+	oaht_group_first(unsigned long long m) {
+		#if defined(__GNUC__)
+		return (unsigned int)__builtin_ctzll(m) >> OAHT_GROUP_SHIFT;
+		#else
+		unsigned int i = 0;
+		while (!(m & 1)) {
+			m >>= 1;
+			i++;
+		}
+		return i >> OAHT_GROUP_SHIFT;
+		#endif
+	}
+#endif
+
+/*
+ * Batched lookups. The keys are processed OAHT_BATCH_SIZE at a time: first
+ * all of them are hashed and their initial probes are prefetched using
+ * OAHT_PREFETCH(addr), then the lookups are done.
+ */
+#ifndef OAHT_BATCH_SIZE
+	#define OAHT_BATCH_SIZE 16
+#endif
+#ifndef OAHT_PREFETCH
+	#if defined(__GNUC__)
+		#define OAHT_PREFETCH(addr) __builtin_prefetch(addr)
+	#else
+		#define OAHT_PREFETCH(addr) ((void)(addr))
+	#endif
+#endif
+
+/*
+ * Parallel resize. If OAHT_PARALLEL_RESIZE is defined, _resize_parallel
+ * rehashes the entries into the new table using several threads. The threads
+ * are started by OAHT_PARALLEL_FOR(n, fn, arg), which must call fn(arg, i)
+ * for i = 0 to n - 1 in parallel and return when all of them have returned.
+ * It defaults to using pthreads.
+ *
+ * If OAHT_RESIZE_THREADS is also defined, set and add grow tables with at least
+ * OAHT_PARALLEL_MIN_USED entries using that many threads.
+ */
+#if defined(OAHT_PARALLEL_RESIZE) && !defined(OAHT_PARALLEL_FOR)
+	#include <pthread.h>
+	#define OAHT_PARALLEL_FOR(n, fn, arg) oaht_parallel_for(n, fn, arg)
+
+	struct oaht_parallel_task {
+		void (*fn)(void *, unsigned);
+		void *arg;
+		unsigned i;
+	};
+
+	static inline void *
+	oaht_parallel_run(void *p) {
+		struct oaht_parallel_task *t = (struct oaht_parallel_task *)p;
+		t->fn(t->arg, t->i);
+		return NULL;
+	}
+
+	static inline void
+	oaht_parallel_for(unsigned n, void (*fn)(void *, unsigned), void *arg) {
+		pthread_t *threads = (pthread_t *)OAHT_ALLOC(n * sizeof(pthread_t));
+		struct oaht_parallel_task *tasks = (struct oaht_parallel_task *)
+			OAHT_ALLOC(n * sizeof(struct oaht_parallel_task));
+		int *started = (int *)OAHT_ALLOC(n * sizeof(int));
+		unsigned i;
+		if (!threads || !tasks || !started) OAHT_OOM();
+		for (i = 0; i < n; i++) {
+			tasks[i].fn = fn;
+			tasks[i].arg = arg;
+			tasks[i].i = i;
+			/* the first task runs in this thread, as does any that can't start */
+			started[i] = i > 0 && pthread_create(&threads[i], NULL,
+			                                     oaht_parallel_run, &tasks[i]) == 0;
+		}
+		for (i = 0; i < n; i++)
+			if (!started[i])
+				fn(arg, i);
+		for (i = 0; i < n; i++)
+			if (started[i])
+				pthread_join(threads[i], NULL);
+		OAHT_FREE(threads, n * sizeof(pthread_t));
+		OAHT_FREE(tasks, n * sizeof(struct oaht_parallel_task));
+		OAHT_FREE(started, n * sizeof(int));
+	}
+#endif
+#ifndef OAHT_PARALLEL_MIN_USED
+	#define OAHT_PARALLEL_MIN_USED 100000
+#endif
+
+/*
+ * Saving and mapping files. If OAHT_MMAP is defined, _save writes a table to
+ * a file and _open_mmap maps such a file read-only, using POSIX functions. The
+ * file has a header recording the layout of the table, and OAHT_HASH_ID,
+ * which should identify the hash function, so that a file is only used with
+ * the same configuration and hash function.
+ */
+#ifdef OAHT_MMAP
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#ifndef OAHT_HASH_ID
+		#define OAHT_HASH_ID 0
+	#endif
+#endif
+
+/*
+ * _build_from sorts the entries until the initial probes of consecutive
+ * entries are within 2^OAHT_BUILD_WINDOW_BITS slots. The slots of the window
+ * should fit in the cache. Defaults to 16.
+ */
+#ifndef OAHT_BUILD_WINDOW_BITS
+	#define OAHT_BUILD_WINDOW_BITS 16
+#endif
+
 /* Minimum capacity, must be a power of 2 */
 #ifndef OAHT_MIN_CAPACITY
 	#define OAHT_MIN_CAPACITY 8
@@ -66,6 +314,12 @@
 	#define OAHT_KEY_EQUALS(a, b) (a == b)
 #endif
 
+/*
+ * Optional identity check, e.g. pointer equality for string keys. If defined,
+ * it's checked before the hash and OAHT_KEY_EQUALS and identical keys are
+ * considered equal without calling OAHT_KEY_EQUALS. Not defined by default.
+ */
+
 /* Value type */
 #ifndef OAHT_VALUE_T
 	#define OAHT_VALUE_T void*
@@ -86,6 +340,19 @@
 	#define OAHT_HASH(key) (OAHT_HASH_T)key
 #endif
 
+/*
+ * Seeded hash function. If OAHT_HASH_FN(key, seed) is defined, it's used
+ * instead of OAHT_HASH, with a seed stored in each table, so that the keys
+ * colliding in one table don't collide in another. oaht_hash.h, which is then
+ * included, provides such functions. The seed of a new table is OAHT_SEED(a).
+ */
+#ifdef OAHT_HASH_FN
+	#include "oaht_hash.h"
+	#ifndef OAHT_SEED
+		#define OAHT_SEED(a) oaht_hash_seed(a)
+	#endif
+#endif
+
 /*
  * Macros for the special key values EMPTY and DELETED. If an empty key is
  * represented by a repeted byte, define OAHT_EMPTY_KEY_BYTE to this value
@@ -108,6 +375,119 @@
 	#define OAHT_IS_DELETED_KEY(key) (key == OAHT_DELETED_KEY)
 #endif
 
+/*
+ * Used internally to check for DELETED slots. With OAHT_BACKSHIFT_DELETE,
+ * there are none, since delete moves the following entries in the cluster
+ * back instead, and OAHT_DELETED_KEY is not used.
+ */
+#if defined(OAHT_ROBIN_HOOD) && !defined(OAHT_BACKSHIFT_DELETE)
+	#error "OAHT_ROBIN_HOOD requires OAHT_BACKSHIFT_DELETE"
+#endif
+#if defined(OAHT_ROBIN_HOOD) && defined(OAHT_CONTROL_BYTES)
+	#error "OAHT_ROBIN_HOOD can't be combined with OAHT_CONTROL_BYTES"
+#endif
+
+/*
+ * Concurrent reads. If OAHT_CONCURRENT_READ is defined, one writer thread can
+ * modify the table while other threads read it without locking, using the
+ * functions in the OAHT_CONCURRENT_READ section at the end of this file. The
+ * keys and values are written and read atomically, a resize always copies the
+ * entries to a new table and DELETED slots are never reused, so that a reader
+ * never sees an entry move or change its key.
+ */
+#ifdef OAHT_CONCURRENT_READ
+	#if !defined(__GNUC__)
+		#error "OAHT_CONCURRENT_READ requires the __atomic builtins of GCC or Clang"
+	#endif
+	#if defined(OAHT_INCREMENTAL_RESIZE) || defined(OAHT_BACKSHIFT_DELETE) || \
+	    defined(OAHT_CONTROL_BYTES)
+		#error "OAHT_CONCURRENT_READ can't be combined with OAHT_INCREMENTAL_RESIZE, OAHT_BACKSHIFT_DELETE or OAHT_CONTROL_BYTES"
+	#endif
+	#ifndef OAHT_MAX_READERS
+		#define OAHT_MAX_READERS 64
+	#endif
+	#ifndef OAHT_CACHE_LINE
+		#define OAHT_CACHE_LINE 64
+	#endif
+#endif
+
+/*
+ * Small tables. If OAHT_SMALL_SIZE is defined, tables with at most this many
+ * slots (a power of 2) don't hash the keys. The keys are packed from the first slot and a
+ * lookup compares the keys one by one until an EMPTY slot, as if the hash of
+ * every key were 0. A small table is only resized when it's full, except for
+ * one EMPTY slot. It then grows to OAHT_SMALL_SIZE slots and, when these are
+ * full, to a normal table and the hashes are computed.
+ */
+#ifdef OAHT_SMALL_SIZE
+	#if defined(OAHT_INCREMENTAL_RESIZE) || defined(OAHT_NO_STORE_HASH)
+		#error "OAHT_SMALL_SIZE can't be combined with OAHT_INCREMENTAL_RESIZE or OAHT_NO_STORE_HASH"
+	#endif
+#endif
+
+/*
+ * Statistics. If OAHT_STATS is defined, each table has counters of the
+ * lookups, their probes and the resizes, which are returned by _stats.
+ * Otherwise, the counting compiles to nothing. The time of the resizes is
+ * measured using OAHT_STATS_CLOCK(), which defaults to clock(). _stats counts
+ * the entries by their distance from their initial probe, up to
+ * OAHT_STATS_DISTANCES - 1 slots, and the last count includes the longer
+ * distances.
+ */
+#ifdef OAHT_STATS
+	#ifdef OAHT_MMAP
+		#error "OAHT_STATS can't be combined with OAHT_MMAP"
+	#endif
+	#ifndef OAHT_STATS_CLOCK
+		#include <time.h>
+		#define OAHT_STATS_CLOCK() ((unsigned long long)clock())
+	#endif
+#endif
+#ifndef OAHT_STATS_DISTANCES
+	#define OAHT_STATS_DISTANCES 16
+#endif
+
+/*
+ * Snapshots. If OAHT_SNAPSHOT is defined, _snapshot takes a consistent view of
+ * a table, which another thread can read while the writer keeps modifying the
+ * table. The slots are divided into pages of OAHT_SNAPSHOT_PAGE slots (a power
+ * of 2). Taking a snapshot only allocates a page pointer per page, and the
+ * entries of a page are copied when the writer first modifies it, shared by
+ * all the snapshots which don't have a copy of it yet. A resize doesn't copy
+ * the entries either: the replaced table is kept, unmodified, until its
+ * snapshots are released.
+ */
+#ifdef OAHT_SNAPSHOT
+	#if !defined(__GNUC__)
+		#error "OAHT_SNAPSHOT requires the __atomic builtins of GCC or Clang"
+	#endif
+	#if defined(OAHT_INCREMENTAL_RESIZE) || defined(OAHT_CONCURRENT_READ)
+		#error "OAHT_SNAPSHOT can't be combined with OAHT_INCREMENTAL_RESIZE or OAHT_CONCURRENT_READ"
+	#endif
+	#ifndef OAHT_SNAPSHOT_PAGE
+		#define OAHT_SNAPSHOT_PAGE 256
+	#endif
+	#if OAHT_SNAPSHOT_PAGE <= 0 || (OAHT_SNAPSHOT_PAGE & (OAHT_SNAPSHOT_PAGE - 1))
+		#error "OAHT_SNAPSHOT_PAGE must be a power of 2"
+	#endif
+#endif
+
+/*
+ * Used internally. With OAHT_SOA, the values are stored in a separate array,
+ * after the entries. (A set has no values, so OAHT_SOA changes nothing.)
+ */
+#undef OAHT_SOA_VALUES
+#if defined(OAHT_SOA) && !defined(OAHT_NO_VALUE)
+	#define OAHT_SOA_VALUES
+#endif
+
+#undef OAHT_IS_DELETED_SLOT
+#ifdef OAHT_BACKSHIFT_DELETE
+	#define OAHT_IS_DELETED_SLOT(key) 0
+#else
+	#define OAHT_IS_DELETED_SLOT(key) OAHT_IS_DELETED_KEY(key)
+#endif
+
 /*
  * Generics: prefix to use instead of 'oaht'. Defaults to oaht.
  */
@@ -125,307 +505,3287 @@
 #undef OAHT_NAME
 #define OAHT_NAME(name) OAHT_XNAME(OAHT_PREFIX, name)
 
-/* A key-value pair */
+/* A key-value pair, or only the key with OAHT_SOA */
 struct OAHT_NAME(_entry) {
 	#ifndef OAHT_NO_STORE_HASH
 	OAHT_HASH_T hash;
 	#endif
 	OAHT_KEY_T key;
-	#ifndef OAHT_NO_VALUE
+	#if !defined(OAHT_NO_VALUE) && !defined(OAHT_SOA_VALUES)
 	OAHT_VALUE_T value;
 	#endif
 };
 
+#ifdef OAHT_SOA_VALUES
+/* For the alignment of the value array. Used internally. */
+struct OAHT_NAME(_value_align) {
+	char c;
+	OAHT_VALUE_T value;
+};
+#endif
+
 /*
  * The hashtable type, optionally prefixed user-defined extra members.
  *
  * There is always at least one EMPTY entry in a table.
+ *
+ * During an incremental resize, used is the number of entries in both this
+ * table and the old table while fill only counts the entries in this table.
+ */
+#ifdef OAHT_STATS
+/* Counters, kept when the table is resized */
+struct OAHT_NAME(_counters) {
+	unsigned long long lookups;      /* calls to _lookup_helper */
+	unsigned long long hits;         /* lookups which found the key */
+	unsigned long long misses;       /* lookups which didn't */
+	unsigned long long probes;       /* slots probed by the lookups */
+	unsigned long long max_probes;   /* most slots probed by one lookup */
+	unsigned long long resizes;      /* calls to _resize and _resize_parallel */
+	unsigned long long moved_bytes;  /* size of the entries rehashed by them */
+	unsigned long long resize_clock; /* their time, see OAHT_STATS_CLOCK */
+};
+#endif
+
+#ifdef OAHT_SNAPSHOT
+/* A copy of a page of slots, shared by the snapshots */
+struct OAHT_NAME(_page) {
+	unsigned long refs;              /* the snapshots sharing the copy */
+	struct OAHT_NAME(_entry) els[OAHT_SNAPSHOT_PAGE];
+	#ifdef OAHT_SOA_VALUES
+	OAHT_VALUE_T values[OAHT_SNAPSHOT_PAGE];
+	#endif
+};
+
+/*
+ * A snapshot returned by _snapshot. The slots of a page without a copy are
+ * read from the table.
  */
+struct OAHT_NAME(_snapshot) {
+	struct OAHT_PREFIX *table;       /* the table it was taken of */
+	struct OAHT_NAME(_snapshot) *next; /* the next older snapshot of it */
+	OAHT_SIZE_T used;                /* the number of entries */
+	OAHT_SIZE_T mask;                /* the mask of the table */
+	struct OAHT_NAME(_page) *pages[1]; /* copies, or NULL, allocated in-place */
+};
+#endif
+
 struct OAHT_PREFIX {
 	#ifdef OAHT_HEADER
 	OAHT_HEADER
 	#endif
 	OAHT_SIZE_T fill;                /* num used + deleted entries */
 	OAHT_SIZE_T used;                /* the number of used entries */
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	struct OAHT_PREFIX *old;         /* table being migrated from, or NULL */
+	OAHT_SIZE_T migrated;            /* num slots of old already migrated */
+	#endif
+	#ifdef OAHT_CONCURRENT_READ
+	struct OAHT_PREFIX *retired;     /* replaced tables, not yet free'd */
+	unsigned long retired_epoch;     /* the epoch when this was retired */
+	#endif
+	#ifdef OAHT_HASH_FN
+	unsigned long long seed;         /* the seed of OAHT_HASH_FN */
+	#endif
+	#ifdef OAHT_STATS
+	struct OAHT_NAME(_counters) counters;
+	#endif
+	#ifdef OAHT_SNAPSHOT
+	struct OAHT_NAME(_snapshot) *snapshots; /* the newest first, or NULL */
+	int replaced;                    /* kept only for the snapshots */
+	#endif
 	OAHT_SIZE_T mask;                /* actual length of els - 1 */
 	struct OAHT_NAME(_entry) els[1]; /* entries, allocated in-place */
 };
 
+#ifdef OAHT_SOA_VALUES
+/*
+ * Offset of the values from the start of a table with mask mask. Used
+ * internally.
+ */
+static inline size_t
+OAHT_NAME(_values_offset)(OAHT_SIZE_T mask) {
+	size_t align = offsetof(struct OAHT_NAME(_value_align), value);
+	size_t size = sizeof(struct OAHT_PREFIX) +
+		mask * sizeof(struct OAHT_NAME(_entry));
+	return (size + align - 1) / align * align;
+}
+
+/* The values, stored after the entries. Used internally. */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_values)(struct OAHT_PREFIX *a) {
+	return (OAHT_VALUE_T *)((char *)a + OAHT_NAME(_values_offset)(a->mask));
+}
+#endif
+
 /* Size to allocate for a struct oaht with mask mask. Used internally. */
 static inline size_t
 OAHT_NAME(_sizeof)(OAHT_SIZE_T mask) {
+	#ifdef OAHT_SOA_VALUES
+	return OAHT_NAME(_values_offset)(mask) +
+		(mask + 1) * sizeof(OAHT_VALUE_T)
+	#else
 	return sizeof(struct OAHT_PREFIX) +
-		mask * sizeof(struct OAHT_NAME(_entry));
+		mask * sizeof(struct OAHT_NAME(_entry))
+	#endif
+		#ifdef OAHT_CONTROL_BYTES
+		/* the first bytes are repeated at the end for unaligned loads */
+		+ mask + OAHT_GROUP_WIDTH
+		#endif
+		;
 }
 
-/* Create a duplicate */
-static inline struct OAHT_PREFIX *
-OAHT_NAME(_clone)(struct OAHT_PREFIX *a) {
-	OAHT_SIZE_T size = OAHT_NAME(_sizeof)(a->mask);
-	struct OAHT_PREFIX *clone = (struct OAHT_PREFIX *)OAHT_ALLOC(size);
-	return memcpy(clone, a, size);
+#ifdef OAHT_CONTROL_BYTES
+/* The control bytes, stored after the entries and values. Used internally. */
+static inline unsigned char *
+OAHT_NAME(_ctrl)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_SOA_VALUES
+	return (unsigned char *)&OAHT_NAME(_values)(a)[a->mask + 1];
+	#else
+	return (unsigned char *)&a->els[a->mask + 1];
+	#endif
 }
+#endif
 
-/* Used internally */
-static inline OAHT_HASH_T
-OAHT_NAME(_get_hash_of_entry)(struct OAHT_NAME(_entry) *e) {
-	#ifndef OAHT_NO_STORE_HASH
-	return e->hash;
+#ifndef OAHT_NO_VALUE
+/* Pointer to the value of an entry in the table. Used internally. */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_value_ptr)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_SOA_VALUES
+	return &OAHT_NAME(_values)(a)[e - a->els];
 	#else
-	return OAHT_HASH(e->key);
+	(void)a;
+	return &e->value;
 	#endif
 }
+#endif
 
 /*
- * Creates an empty hashtable of a given initial size.
+ * Copies the entry src in table b to the slot dst in table a, including the
+ * value. The control byte is not updated. Used internally.
  */
-static inline struct OAHT_PREFIX *
-OAHT_NAME(_create_presized)(OAHT_SIZE_T min_size) {
-	OAHT_SIZE_T size = OAHT_MIN_CAPACITY;
-	OAHT_SIZE_T mask;
-	struct OAHT_PREFIX *a;
-	assert(min_size >= 0);
-	assert(OAHT_MIN_CAPACITY > 0);
-	/* Compute size, the smallest power of 2 >= min_size */
-	while (size < min_size) {
-		size *= 2;
-		if (size < OAHT_MIN_CAPACITY) OAHT_OOM(); /* overflow */
-	}
-	mask = size - 1;
-	a = (struct OAHT_PREFIX *)OAHT_ALLOC(OAHT_NAME(_sizeof)(mask));
-	if (!a) OAHT_OOM();
-	#ifdef OAHT_EMPTY_KEY_BYTE
-	# if OAHT_EMPTY_KEY_BYTE == 0
-	memset(a, 0, OAHT_NAME(_sizeof)(mask));
-	# else
-	memset(a, 0, offsetof(struct OAHT_PREFIX, mask));
-	memset(a + offsetof(struct OAHT_PREFIX, mask),
-	       OAHT_EMPTY_KEY_BYTE,
-	       OAHT_NAME(_sizeof)(mask) -
-	           offsetof(struct OAHT_PREFIX, mask));
-	# endif
+static inline void
+OAHT_NAME(_copy_entry)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *dst,
+                       struct OAHT_PREFIX *b, struct OAHT_NAME(_entry) *src) {
+	memcpy(dst, src, sizeof(struct OAHT_NAME(_entry)));
+	#ifdef OAHT_SOA_VALUES
+	memcpy(OAHT_NAME(_value_ptr)(a, dst), OAHT_NAME(_value_ptr)(b, src),
+	       sizeof(OAHT_VALUE_T));
 	#else
-	memset(a, 0, offsetof(struct OAHT_PREFIX, mask));
-	{
-		OAHT_SIZE_T i;
-		for (i = 0; i < size; i++)
-			a->els[i].key = OAHT_EMPTY_KEY;
-	}
+	(void)a;
+	(void)b;
 	#endif
-	a->mask = mask;
-	assert(OAHT_IS_EMPTY_KEY(a->els[0].key));
-	return a;
 }
 
 /*
- * Creates an empty hashtable with the minimum initial size.
+ * Reads and writes of the keys and values which may be accessed by readers
+ * at the same time. With OAHT_CONCURRENT_READ, the writes have release
+ * semantics and the reads acquire semantics, so that a reader which sees a
+ * key also sees its hash and value. Otherwise, these are plain reads and
+ * writes. Used internally.
  */
+static inline OAHT_KEY_T
+OAHT_NAME(_load_key)(struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_CONCURRENT_READ
+	OAHT_KEY_T key;
+	__atomic_load(&e->key, &key, __ATOMIC_ACQUIRE);
+	return key;
+	#else
+	return e->key;
+	#endif
+}
+
+static inline void
+OAHT_NAME(_store_key)(struct OAHT_NAME(_entry) *e, OAHT_KEY_T key) {
+	#ifdef OAHT_CONCURRENT_READ
+	__atomic_store(&e->key, &key, __ATOMIC_RELEASE);
+	#else
+	e->key = key;
+	#endif
+}
+
+#ifndef OAHT_NO_VALUE
+static inline OAHT_VALUE_T
+OAHT_NAME(_load_value)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_CONCURRENT_READ
+	OAHT_VALUE_T value;
+	__atomic_load(OAHT_NAME(_value_ptr)(a, e), &value, __ATOMIC_ACQUIRE);
+	return value;
+	#else
+	return *OAHT_NAME(_value_ptr)(a, e);
+	#endif
+}
+
+static inline void
+OAHT_NAME(_store_value)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                        OAHT_VALUE_T const *value) {
+	#ifdef OAHT_CONCURRENT_READ
+	__atomic_store(OAHT_NAME(_value_ptr)(a, e), (OAHT_VALUE_T *)value,
+	               __ATOMIC_RELEASE);
+	#else
+	*OAHT_NAME(_value_ptr)(a, e) = *value;
+	#endif
+}
+#endif
+
+/* Create a duplicate */
 static inline struct OAHT_PREFIX *
-OAHT_NAME(_create)(void) {
-	return OAHT_NAME(_create_presized)(OAHT_MIN_CAPACITY);
+OAHT_NAME(_clone)(struct OAHT_PREFIX *a) {
+	OAHT_SIZE_T size = OAHT_NAME(_sizeof)(a->mask);
+	struct OAHT_PREFIX *clone = (struct OAHT_PREFIX *)OAHT_ALLOC(size);
+	if (!clone) OAHT_OOM();
+	memcpy(clone, a, size);
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		clone->old = OAHT_NAME(_clone)(a->old);
+	#endif
+	#ifdef OAHT_CONCURRENT_READ
+	clone->retired = NULL;
+	#endif
+	#ifdef OAHT_SNAPSHOT
+	clone->snapshots = NULL;
+	#endif
+	return clone;
+}
+
+/*
+ * Checks if snapshots are reading the table, so that it must not be modified
+ * without copying the pages first nor be resized in place. Used internally.
+ */
+static inline int
+OAHT_NAME(_is_shared)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_SNAPSHOT
+	return a->snapshots != NULL;
+	#else
+	(void)a;
+	return 0;
+	#endif
 }
 
 /*
- * Frees the memory.
+ * Frees a table which has been replaced by a resize or destroyed. A table
+ * read by snapshots is kept until they're released. Used internally.
  */
 static inline void
-OAHT_NAME(_destroy)(struct OAHT_PREFIX *a) {
+OAHT_NAME(_free_replaced)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_SNAPSHOT
+	if (a->snapshots) {
+		a->replaced = 1;
+		return;
+	}
+	#endif
 	OAHT_FREE(a, OAHT_NAME(_sizeof)(a->mask));
 }
 
+#ifdef OAHT_SNAPSHOT
 /*
- * Returns the number of entries in the hashtable.
+ * Copies a page of slots for the snapshots which don't have a copy of it.
+ * These are the newest ones, since a copy made for a snapshot is also given
+ * to the older ones without a copy. The pointers to the copy are stored
+ * before the writer modifies the page, so that a reader which reads a slot
+ * from the table and then still finds no copy has read it unmodified. Used
+ * internally.
  */
-static inline OAHT_SIZE_T
-OAHT_NAME(_len)(struct OAHT_PREFIX *a) {
-	return a->used;
+static inline void
+OAHT_NAME(_copy_page)(struct OAHT_PREFIX *a, OAHT_SIZE_T page) {
+	struct OAHT_NAME(_snapshot) *s = a->snapshots;
+	struct OAHT_NAME(_page) *copy;
+	OAHT_SIZE_T start = page * OAHT_SNAPSHOT_PAGE, n = a->mask + 1 - start;
+	if (!s || s->pages[page])
+		return;
+	if (n > OAHT_SNAPSHOT_PAGE)
+		n = OAHT_SNAPSHOT_PAGE;
+	copy = (struct OAHT_NAME(_page) *)
+		OAHT_ALLOC(sizeof(struct OAHT_NAME(_page)));
+	if (!copy) OAHT_OOM();
+	memcpy(copy->els, &a->els[start], n * sizeof(struct OAHT_NAME(_entry)));
+	#ifdef OAHT_SOA_VALUES
+	memcpy(copy->values, &OAHT_NAME(_values)(a)[start],
+	       n * sizeof(OAHT_VALUE_T));
+	#endif
+	copy->refs = 0;
+	for (; s && !s->pages[page]; s = s->next) {
+		copy->refs++;
+		__atomic_store_n(&s->pages[page], copy, __ATOMIC_RELEASE);
+	}
+	/* the following writes to the page aren't seen before the pointers */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
 }
+#endif
 
 /*
- * A function to iterate over the keys and values. Start by passing pos = 0.
- * Pass the return value as i to get the next entry. When 0 is returned, there
- * is no more entry to get.
- *
- * If a non-zero value is returned, k and v are assigned to point to a key and
- * a value in the hashtable.
+ * Called before modifying the slot of e and, if cluster is 1, the slots
+ * after it up to the next EMPTY one, which an insert or delete may move the
+ * entries to. Copies their pages for the snapshots. This does nothing unless
+ * OAHT_SNAPSHOT is defined. Used internally.
  */
-static inline OAHT_SIZE_T
-OAHT_NAME(_iter)(struct OAHT_PREFIX *a, OAHT_SIZE_T pos, OAHT_KEY_T *k, OAHT_VALUE_T *v) {
-	for (; pos <= a->mask; pos++) {
-		if (OAHT_IS_EMPTY_KEY(a->els[pos].key) ||
-			OAHT_IS_DELETED_KEY(a->els[pos].key))
-			continue;
-		*k = a->els[pos].key;
-		*v = a->els[pos].value;
-		return pos + 1;
+static inline void
+OAHT_NAME(_will_modify)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                        int cluster) {
+	#ifdef OAHT_SNAPSHOT
+	OAHT_SIZE_T pos = (OAHT_SIZE_T)(e - a->els);
+	if (!a->snapshots)
+		return;
+	OAHT_NAME(_copy_page)(a, pos / OAHT_SNAPSHOT_PAGE);
+	while (cluster && !OAHT_IS_EMPTY_KEY(a->els[pos].key)) {
+		pos = (pos + 1) & a->mask;
+		if (pos % OAHT_SNAPSHOT_PAGE == 0)
+			OAHT_NAME(_copy_page)(a, pos / OAHT_SNAPSHOT_PAGE);
 	}
-	/* There are no more entries. */
+	#else
+	(void)a;
+	(void)e;
+	(void)cluster;
+	#endif
+}
+
+/* Checks if a table with this mask is a small table. Used internally. */
+static inline int
+OAHT_NAME(_is_small)(OAHT_SIZE_T mask) {
+	#ifdef OAHT_SMALL_SIZE
+	return mask < OAHT_SMALL_SIZE;
+	#else
+	(void)mask;
 	return 0;
+	#endif
 }
 
 /*
- * Lookup an entry by its key. Returns a pointer to an entry that can be
- * assigned to, to insert or replace a value in the table. If the returned
- * entry is EMPTY or DELETED, the key is not present in the table.
- *
- * This function is used by many of the other functions (set, get, delete).
+ * Returns the hash of a key, which can be passed to the functions ending in
+ * _h instead of the key being hashed again, e.g. to look up a key in several
+ * tables. With OAHT_HASH_FN, the hash depends on the seed of the table, which
+ * is kept when it's resized, so it's only valid for tables with the same seed.
+ */
+static inline OAHT_HASH_T
+OAHT_NAME(_hash)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	#ifdef OAHT_HASH_FN
+	return (OAHT_HASH_T)OAHT_HASH_FN(key, a->seed);
+	#else
+	(void)a;
+	return OAHT_HASH(key);
+	#endif
+}
+
+/*
+ * The hash of a key for a lookup in the table. It's 0 for all keys in a small
+ * table. Used internally.
+ */
+static inline OAHT_HASH_T
+OAHT_NAME(_hash_of)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	if (OAHT_NAME(_is_small)(a->mask))
+		return 0;
+	return OAHT_NAME(_hash)(a, key);
+}
+
+/*
+ * The hash for a lookup of a key whose hash, as returned by _hash, is given.
+ * Used internally.
+ */
+static inline OAHT_HASH_T
+OAHT_NAME(_hash_given)(struct OAHT_PREFIX *a, OAHT_HASH_T hash) {
+	return OAHT_NAME(_is_small)(a->mask) ? 0 : hash;
+}
+
+/*
+ * The hash of an entry in the table a, stored or, with OAHT_NO_STORE_HASH,
+ * computed. Used internally.
+ */
+static inline OAHT_HASH_T
+OAHT_NAME(_get_hash_of_entry)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifndef OAHT_NO_STORE_HASH
+	(void)a;
+	return e->hash;
+	#else
+	return OAHT_NAME(_hash)(a, e->key);
+	#endif
+}
+
+/*
+ * Updates the control byte of an entry after its key has been written. This
+ * does nothing unless OAHT_CONTROL_BYTES is defined. Used internally.
+ */
+static inline void
+OAHT_NAME(_sync_ctrl)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_CONTROL_BYTES
+	unsigned char *ctrl = OAHT_NAME(_ctrl)(a);
+	OAHT_SIZE_T pos = (OAHT_SIZE_T)(e - a->els), cap = a->mask + 1;
+	unsigned char c = OAHT_IS_EMPTY_KEY(e->key) ? OAHT_CTRL_EMPTY
+		: OAHT_IS_DELETED_SLOT(e->key) ? OAHT_CTRL_DELETED
+		: OAHT_CTRL_H2(OAHT_NAME(_get_hash_of_entry)(a, e));
+	ctrl[pos] = c;
+	/* the copies at the end, possibly several for a small table */
+	for (pos += cap; pos < cap + OAHT_GROUP_WIDTH - 1; pos += cap)
+		ctrl[pos] = c;
+	#else
+	(void)a;
+	(void)e;
+	#endif
+}
+
+/*
+ * Like _sync_ctrl, for a used slot whose hash is given, so that it isn't
+ * computed again with OAHT_NO_STORE_HASH. Used internally.
+ */
+static inline void
+OAHT_NAME(_sync_ctrl_h)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                        OAHT_HASH_T hash) {
+	#ifdef OAHT_CONTROL_BYTES
+	unsigned char *ctrl = OAHT_NAME(_ctrl)(a);
+	OAHT_SIZE_T pos = (OAHT_SIZE_T)(e - a->els), cap = a->mask + 1;
+	unsigned char c = OAHT_CTRL_H2(hash);
+	for (; pos < cap + OAHT_GROUP_WIDTH - 1; pos += cap)
+		ctrl[pos] = c;
+	#else
+	(void)a;
+	(void)e;
+	(void)hash;
+	#endif
+}
+
+/*
+ * The mask for the smallest capacity, a power of 2, which is >= min_size.
+ * Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_mask_for)(OAHT_SIZE_T min_size) {
+	OAHT_SIZE_T size = OAHT_MIN_CAPACITY;
+	assert(min_size >= 0);
+	assert(OAHT_MIN_CAPACITY > 0);
+	while (size < min_size) {
+		size *= 2;
+		if (size < OAHT_MIN_CAPACITY) OAHT_OOM(); /* overflow */
+	}
+	return size - 1;
+}
+
+/*
+ * Returns the smallest size where n entries are below the maximum load.
+ * Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_min_size)(OAHT_SIZE_T n) {
+	return n * OAHT_MAX_LOAD_DEN / OAHT_MAX_LOAD_NUM + 1;
+}
+
+/*
+ * Checks if fill slots are too many for the size. A small table only needs
+ * one EMPTY slot. Used internally.
+ */
+static inline int
+OAHT_NAME(_is_overloaded)(OAHT_SIZE_T fill, OAHT_SIZE_T mask) {
+	if (OAHT_NAME(_is_small)(mask))
+		return fill > mask;
+	return fill * OAHT_MAX_LOAD_DEN >= (mask + 1) * OAHT_MAX_LOAD_NUM;
+}
+
+/*
+ * Creates an empty hashtable of a given initial size.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_create_presized)(OAHT_SIZE_T min_size) {
+	OAHT_SIZE_T mask = OAHT_NAME(_mask_for)(min_size);
+	struct OAHT_PREFIX *a;
+	a = (struct OAHT_PREFIX *)OAHT_ALLOC(OAHT_NAME(_sizeof)(mask));
+	if (!a) OAHT_OOM();
+	#ifdef OAHT_EMPTY_KEY_BYTE
+	# if OAHT_EMPTY_KEY_BYTE == 0
+	memset(a, 0, OAHT_NAME(_sizeof)(mask));
+	# else
+	memset(a, 0, offsetof(struct OAHT_PREFIX, mask));
+	memset((char *)a + offsetof(struct OAHT_PREFIX, mask),
+	       OAHT_EMPTY_KEY_BYTE,
+	       OAHT_NAME(_sizeof)(mask) -
+	           offsetof(struct OAHT_PREFIX, mask));
+	# endif
+	#else
+	memset(a, 0, offsetof(struct OAHT_PREFIX, mask));
+	{
+		OAHT_SIZE_T i;
+		for (i = 0; i <= mask; i++)
+			a->els[i].key = OAHT_EMPTY_KEY;
+	}
+	#endif
+	a->mask = mask;
+	#ifdef OAHT_HASH_FN
+	a->seed = OAHT_SEED(a);
+	#endif
+	#ifdef OAHT_CONTROL_BYTES
+	memset(OAHT_NAME(_ctrl)(a), OAHT_CTRL_EMPTY, mask + OAHT_GROUP_WIDTH);
+	#endif
+	assert(OAHT_IS_EMPTY_KEY(a->els[0].key));
+	return a;
+}
+
+/*
+ * Creates an empty hashtable with the minimum initial size.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_create)(void) {
+	return OAHT_NAME(_create_presized)(OAHT_MIN_CAPACITY);
+}
+
+/*
+ * Frees the memory. With OAHT_SNAPSHOT, the memory of a table with snapshots
+ * is free'd when they're released.
+ */
+static inline void
+OAHT_NAME(_destroy)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		OAHT_NAME(_destroy)(a->old);
+	#endif
+	#ifdef OAHT_CONCURRENT_READ
+	/* and the tables it has replaced */
+	while (a->retired) {
+		struct OAHT_PREFIX *r = a->retired;
+		a->retired = r->retired;
+		OAHT_FREE(r, OAHT_NAME(_sizeof)(r->mask));
+	}
+	#endif
+	OAHT_NAME(_free_replaced)(a);
+}
+
+/*
+ * Returns the number of entries in the hashtable.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_len)(struct OAHT_PREFIX *a) {
+	return a->used;
+}
+
+/*
+ * Returns the first used entry in the slots from pos to the end of the table,
+ * or NULL if there is none. With OAHT_CONTROL_BYTES, the empty and deleted
+ * slots are skipped a group of control bytes at a time. Used internally.
+ */
+static inline struct OAHT_NAME(_entry) *
+OAHT_NAME(_next_used)(struct OAHT_PREFIX *a, OAHT_SIZE_T pos) {
+	#ifdef OAHT_CONTROL_BYTES
+	for (; pos <= a->mask; pos += OAHT_GROUP_WIDTH) {
+		unsigned long long used = oaht_group_used(OAHT_NAME(_ctrl)(a) + pos);
+		if (used) {
+			/* the group may reach into the copies after the last slot */
+			pos += oaht_group_first(used);
+			return pos <= a->mask ? &a->els[pos] : NULL;
+		}
+	}
+	#else
+	for (; pos <= a->mask; pos++)
+		if (!OAHT_IS_EMPTY_KEY(a->els[pos].key) &&
+		    !OAHT_IS_DELETED_SLOT(a->els[pos].key))
+			return &a->els[pos];
+	#endif
+	return NULL;
+}
+
+/*
+ * Returns the next entry in the hashtable, or NULL when there are no more
+ * entries. Start by passing a pointer to pos = 0; pos is updated to point
+ * past the entry. Nothing is copied: the key of the entry is e->key and its
+ * value is returned by _entry_value. The table must not be modified during
+ * the iteration.
+ */
+static inline struct OAHT_NAME(_entry) *
+OAHT_NAME(_next)(struct OAHT_PREFIX *a, OAHT_SIZE_T *pos) {
+	struct OAHT_NAME(_entry) *e = NULL;
+	if (*pos <= a->mask) {
+		e = OAHT_NAME(_next_used)(a, *pos);
+		if (e) {
+			*pos = (OAHT_SIZE_T)(e - a->els) + 1;
+			return e;
+		}
+		*pos = a->mask + 1;
+	}
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* Positions after the last slot continue in the old table. */
+	if (a->old) {
+		e = OAHT_NAME(_next_used)(a->old, *pos - (a->mask + 1));
+		if (e)
+			*pos = a->mask + 1 + (OAHT_SIZE_T)(e - a->old->els) + 1;
+	}
+	#endif
+	return e;
+}
+
+#ifndef OAHT_NO_VALUE
+/* Returns a pointer to the value of an entry returned by _next. */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_entry_value)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old && (e < a->els || e > &a->els[a->mask]))
+		return OAHT_NAME(_value_ptr)(a->old, e);
+	#endif
+	return OAHT_NAME(_value_ptr)(a, e);
+}
+#endif
+
+/*
+ * A function to iterate over the keys and values. Start by passing pos = 0.
+ * Pass the return value as i to get the next entry. When 0 is returned, there
+ * is no more entry to get.
+ *
+ * If a non-zero value is returned, k and v are assigned to point to a key and
+ * a value in the hashtable. v may be NULL and is not used if OAHT_NO_VALUE is
+ * defined.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_iter)(struct OAHT_PREFIX *a, OAHT_SIZE_T pos, OAHT_KEY_T *k, OAHT_VALUE_T *v) {
+	struct OAHT_NAME(_entry) *e = OAHT_NAME(_next)(a, &pos);
+	if (!e)
+		return 0;
+	*k = e->key;
+	#ifndef OAHT_NO_VALUE
+	if (v)
+		*v = *OAHT_NAME(_entry_value)(a, e);
+	#else
+	(void)v;
+	#endif
+	return pos;
+}
+
+/*
+ * Calls fn for each entry whose initial probe in the table b is the slot
+ * bucket. These are at this slot or after it, before the next EMPTY slot. With
+ * all = 1, fn is called for all entries of the table instead. Used internally.
+ */
+static inline void
+OAHT_NAME(_scan_bucket)(struct OAHT_PREFIX *b, OAHT_SIZE_T bucket, int all,
+#ifndef OAHT_NO_VALUE
+                        void (*fn)(void *arg, OAHT_KEY_T const *key,
+                                   OAHT_VALUE_T *value),
+#else
+                        void (*fn)(void *arg, OAHT_KEY_T const *key),
+#endif
+                        void *arg) {
+	OAHT_SIZE_T pos = bucket;
+	while (1) {
+		struct OAHT_NAME(_entry) *e = all
+			? OAHT_NAME(_next_used)(b, pos)
+			: &b->els[pos];
+		if (!e || OAHT_IS_EMPTY_KEY(e->key))
+			return;
+		if (!OAHT_IS_DELETED_SLOT(e->key) &&
+		    (all || (OAHT_NAME(_get_hash_of_entry)(b, e) & b->mask) == bucket)) {
+			#ifndef OAHT_NO_VALUE
+			fn(arg, &e->key, OAHT_NAME(_value_ptr)(b, e));
+			#else
+			fn(arg, &e->key);
+			#endif
+		}
+		pos = all ? (OAHT_SIZE_T)(e - b->els) + 1 : (pos + 1) & b->mask;
+	}
+}
+
+/*
+ * Scans the hashtable a part at a time without keeping any state in it. Start
+ * by passing cursor = 0 and pass the returned cursor to the next call. When 0
+ * is returned, the scan is complete. Each call calls fn for the entries whose
+ * initial probe is the slot of the cursor, with pointers to their key and
+ * value in the table. fn must not modify the table.
+ *
+ * Like the SCAN command of Redis, the cursor is incremented in reverse bit
+ * order, so the table may be modified and resized between the calls: each
+ * entry which is in the table during the whole scan is visited at least once,
+ * but entries may be visited more than once.
+ */
+static inline OAHT_SIZE_T
+#ifndef OAHT_NO_VALUE
+OAHT_NAME(_scan)(struct OAHT_PREFIX *a, OAHT_SIZE_T cursor,
+                 void (*fn)(void *arg, OAHT_KEY_T const *key,
+                            OAHT_VALUE_T *value),
+                 void *arg) {
+#else
+OAHT_NAME(_scan)(struct OAHT_PREFIX *a, OAHT_SIZE_T cursor,
+                 void (*fn)(void *arg, OAHT_KEY_T const *key), void *arg) {
+#endif
+	struct OAHT_PREFIX *tables[2];
+	OAHT_SIZE_T mask = a->mask, bit;
+	int i, n = 1;
+	tables[0] = a;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* the cursor counts the slots of the smaller table */
+	if (a->old) {
+		tables[n++] = a->old;
+		if (a->old->mask < mask)
+			mask = a->old->mask;
+	}
+	#endif
+	if (OAHT_NAME(_is_small)(a->mask)) {
+		/* the initial probes are all 0, so all the entries are visited */
+		OAHT_NAME(_scan_bucket)(a, 0, 1, fn, arg);
+		return 0;
+	}
+	cursor &= mask;
+	for (i = 0; i < n; i++) {
+		OAHT_SIZE_T bucket;
+		for (bucket = cursor; bucket <= tables[i]->mask; bucket += mask + 1)
+			OAHT_NAME(_scan_bucket)(tables[i], bucket, 0, fn, arg);
+	}
+	/* increment the cursor from its highest bit */
+	for (bit = (mask >> 1) + 1; cursor & bit; bit >>= 1)
+		cursor &= ~bit;
+	return cursor | bit;
+}
+
+#ifdef OAHT_STATS
+/*
+ * Copies the counters of a to c, atomically with OAHT_CONCURRENT_READ. Used
+ * internally.
+ */
+static inline void
+OAHT_NAME(_load_counters)(struct OAHT_PREFIX *a, struct OAHT_NAME(_counters) *c) {
+	#ifdef OAHT_CONCURRENT_READ
+	unsigned long long *src = (unsigned long long *)&a->counters;
+	unsigned long long *dst = (unsigned long long *)c;
+	size_t i;
+	for (i = 0; i < sizeof(*c) / sizeof(*dst); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+	#else
+	*c = a->counters;
+	#endif
+}
+#endif
+
+/* The statistics of a table, see _stats. */
+struct OAHT_NAME(_stats) {
+	OAHT_SIZE_T size;                /* the number of slots */
+	OAHT_SIZE_T used;                /* the number of used entries */
+	OAHT_SIZE_T deleted;             /* the number of DELETED slots */
+	double load;                     /* used / size */
+	double fill;                     /* (used + deleted) / size */
+	OAHT_SIZE_T max_distance;        /* from an entry to its initial probe */
+	double mean_distance;
+	OAHT_SIZE_T distances[OAHT_STATS_DISTANCES]; /* entries by distance */
+	OAHT_SIZE_T clusters;            /* runs of non-EMPTY slots */
+	OAHT_SIZE_T max_cluster;         /* the length of the longest run */
+	double mean_cluster;
+	#ifdef OAHT_STATS
+	struct OAHT_NAME(_counters) counters;
+	#endif
+};
+
+/*
+ * Adds the slots of the table b to s, and the sums of the distances and the
+ * cluster lengths to sums. Used internally by _stats.
+ */
+static inline void
+OAHT_NAME(_stats_table)(struct OAHT_PREFIX *b, struct OAHT_NAME(_stats) *s,
+                        double sums[2]) {
+	int small = OAHT_NAME(_is_small)(b->mask);
+	OAHT_SIZE_T i, pos, d, run = 0, start = b->mask;
+	/*
+	 * The clusters wrap around, so they're counted from an EMPTY slot. A
+	 * small table may have none, but its clusters don't wrap around.
+	 */
+	if (!small)
+		for (start = 0; !OAHT_IS_EMPTY_KEY(b->els[start].key); start++)
+			;
+	s->size += b->mask + 1;
+	for (i = 1; i <= b->mask + 1; i++) {
+		struct OAHT_NAME(_entry) *e = &b->els[pos = (start + i) & b->mask];
+		if (!OAHT_IS_EMPTY_KEY(e->key)) {
+			run++;
+			if (OAHT_IS_DELETED_SLOT(e->key)) {
+				s->deleted++;
+			} else if (small) {
+				/* the keys aren't hashed, so the distance is 0 */
+				s->used++;
+				s->distances[0]++;
+			} else {
+				s->used++;
+				d = (pos - OAHT_NAME(_get_hash_of_entry)(b, e)) & b->mask;
+				if (d > s->max_distance)
+					s->max_distance = d;
+				s->distances[d < OAHT_STATS_DISTANCES - 1
+				             ? d : OAHT_STATS_DISTANCES - 1]++;
+				sums[0] += d;
+			}
+		}
+		if (run && (OAHT_IS_EMPTY_KEY(e->key) || pos == start)) {
+			s->clusters++;
+			if (run > s->max_cluster)
+				s->max_cluster = run;
+			sums[1] += run;
+			run = 0;
+		}
+	}
+}
+
+/*
+ * Computes the statistics of the table: its load, the distances of the entries
+ * from their initial probes, the clusters of non-EMPTY slots and, if
+ * OAHT_STATS is defined, the counters. With OAHT_INCREMENTAL_RESIZE, the old
+ * table is included. Every slot is visited, so it takes time proportional to
+ * the size of the table.
+ */
+static inline void
+OAHT_NAME(_stats)(struct OAHT_PREFIX *a, struct OAHT_NAME(_stats) *s) {
+	double sums[2] = {0, 0};
+	memset(s, 0, sizeof(*s));
+	OAHT_NAME(_stats_table)(a, s, sums);
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		OAHT_NAME(_stats_table)(a->old, s, sums);
+	#endif
+	s->load = (double)s->used / s->size;
+	s->fill = (double)(s->used + s->deleted) / s->size;
+	if (s->used)
+		s->mean_distance = sums[0] / s->used;
+	if (s->clusters)
+		s->mean_cluster = sums[1] / s->clusters;
+	#ifdef OAHT_STATS
+	OAHT_NAME(_load_counters)(a, &s->counters);
+	#endif
+}
+
+/*
+ * Check if the entry in a non-EMPTY slot holds the key. The stored hash is
+ * compared first, so that OAHT_KEY_EQUALS is only called when the hashes are
+ * equal. Used internally.
+ */
+static inline int
+OAHT_NAME(_entry_matches)(struct OAHT_NAME(_entry) *e, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	OAHT_KEY_T k = OAHT_NAME(_load_key)(e);
+	#ifdef OAHT_KEY_IDENTICAL
+	if (OAHT_KEY_IDENTICAL(k, key))
+		return 1;
+	#endif
+	#ifndef OAHT_NO_STORE_HASH
+	if (e->hash != hash)
+		return 0;
+	#else
+	(void)hash;
+	#endif
+	return !OAHT_IS_DELETED_SLOT(k) && OAHT_KEY_EQUALS(k, key);
+}
+
+#ifdef OAHT_ROBIN_HOOD
+/* The distance from an entry's initial probe to its position. Used internally. */
+static inline OAHT_SIZE_T
+OAHT_NAME(_probe_distance)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e, OAHT_SIZE_T pos) {
+	return (pos - OAHT_NAME(_get_hash_of_entry)(a, e)) & a->mask;
+}
+#endif
+
+/*
+ * Counts a lookup which probed the slots from start to last, if OAHT_STATS is
+ * defined. With OAHT_CONCURRENT_READ, the readers count their lookups too, as
+ * do the threads of the parallel set operations with OAHT_PARALLEL_RESIZE, so
+ * the counters are updated atomically, but the maximum is approximate. Used
+ * internally.
+ */
+static inline void
+OAHT_NAME(_count_lookup)(struct OAHT_PREFIX *a, OAHT_SIZE_T start,
+                         OAHT_SIZE_T last, int hit) {
+	#ifdef OAHT_STATS
+	struct OAHT_NAME(_counters) *c = &a->counters;
+	unsigned long long n = ((last - start) & a->mask) + 1;
+	#if defined(OAHT_CONCURRENT_READ) || defined(OAHT_PARALLEL_RESIZE)
+	__atomic_fetch_add(&c->lookups, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(hit ? &c->hits : &c->misses, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&c->probes, n, __ATOMIC_RELAXED);
+	if (n > __atomic_load_n(&c->max_probes, __ATOMIC_RELAXED))
+		__atomic_store_n(&c->max_probes, n, __ATOMIC_RELAXED);
+	#else
+	c->lookups++;
+	if (hit)
+		c->hits++;
+	else
+		c->misses++;
+	c->probes += n;
+	if (n > c->max_probes)
+		c->max_probes = n;
+	#endif
+	#else
+	(void)a;
+	(void)start;
+	(void)last;
+	(void)hit;
+	#endif
+}
+
+/*
+ * Lookup an entry by its key. Returns a pointer to an entry that can be
+ * assigned to, to insert or replace a value in the table. If the returned
+ * entry is EMPTY or DELETED, the key is not present in the table.
+ *
+ * With OAHT_ROBIN_HOOD, the lookup of a missing key stops at the first entry
+ * which is closer to its initial probe than the key would be, and this entry
+ * is returned. Use _is_miss to check the result and _make_room before
+ * inserting.
+ *
+ * This function is used by many of the other functions (set, get, delete).
  */
 static inline struct OAHT_NAME(_entry) *
 OAHT_NAME(_lookup_helper)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
-	OAHT_SIZE_T pos = hash & a->mask; /* initial probe */
+	OAHT_SIZE_T start = hash & a->mask; /* initial probe */
+	OAHT_SIZE_T pos = start;
+	#ifndef OAHT_BACKSHIFT_DELETE
 	struct OAHT_NAME(_entry) *freeslot = NULL;
+	#endif
+	#ifdef OAHT_ROBIN_HOOD
+	OAHT_SIZE_T dist = 0;
+	#endif
 	assert(!OAHT_IS_EMPTY_KEY(key));
-	assert(!OAHT_IS_DELETED_KEY(key));
+	assert(!OAHT_IS_DELETED_SLOT(key));
 	/* This will always terminate as there is always one empty entry */
+	#if defined(OAHT_CONTROL_BYTES)
 	while (1) {
-		if (OAHT_IS_EMPTY_KEY(a->els[pos].key))
+		/* a group of control bytes, starting at pos */
+		const unsigned char *g = OAHT_NAME(_ctrl)(a) + pos;
+		unsigned long long match = oaht_group_match(g, OAHT_CTRL_H2(hash));
+		unsigned long long empty = oaht_group_match(g, OAHT_CTRL_EMPTY);
+		/* only the slots before the first EMPTY one are part of the probe */
+		unsigned long long before = empty ? (empty & (0 - empty)) - 1 : ~0ULL;
+		for (match &= before; match; match &= match - 1) {
+			struct OAHT_NAME(_entry) *e =
+				&a->els[(pos + oaht_group_first(match)) & a->mask];
+			if (OAHT_NAME(_entry_matches)(e, key, hash)) {
+				OAHT_NAME(_count_lookup)(a, start,
+				                         (OAHT_SIZE_T)(e - a->els), 1);
+				return e;
+			}
+		}
+		#ifndef OAHT_BACKSHIFT_DELETE
+		if (!freeslot) {
+			unsigned long long deleted =
+				oaht_group_match(g, OAHT_CTRL_DELETED) & before;
+			if (deleted)
+				freeslot = &a->els[(pos + oaht_group_first(deleted)) & a->mask];
+		}
+		#endif
+		if (empty) {
+			struct OAHT_NAME(_entry) *e =
+				&a->els[(pos + oaht_group_first(empty)) & a->mask];
+			OAHT_NAME(_count_lookup)(a, start, (OAHT_SIZE_T)(e - a->els), 0);
+			#ifndef OAHT_BACKSHIFT_DELETE
+			if (freeslot)
+				return freeslot;
+			#endif
+			return e;
+		}
+		pos = (pos + OAHT_GROUP_WIDTH) & a->mask;
+	}
+	#elif defined(OAHT_BACKSHIFT_DELETE)
+	while (1) {
+		if (OAHT_IS_EMPTY_KEY(a->els[pos].key)) {
+			OAHT_NAME(_count_lookup)(a, start, pos, 0);
+			return &a->els[pos];
+		}
+		if (OAHT_NAME(_entry_matches)(&a->els[pos], key, hash)) {
+			OAHT_NAME(_count_lookup)(a, start, pos, 1);
+			return &a->els[pos];
+		}
+		#ifdef OAHT_ROBIN_HOOD
+		/* the key would have displaced this entry if it were present */
+		if (OAHT_NAME(_probe_distance)(a, &a->els[pos], pos) < dist) {
+			OAHT_NAME(_count_lookup)(a, start, pos, 0);
+			return &a->els[pos];
+		}
+		dist++;
+		#endif
+		pos = (pos + 1) & a->mask;
+	}
+	#else
+	while (1) {
+		if (OAHT_IS_EMPTY_KEY(OAHT_NAME(_load_key)(&a->els[pos]))) {
+			OAHT_NAME(_count_lookup)(a, start, pos, 0);
 			return freeslot ? freeslot : &a->els[pos];
-		if (OAHT_KEY_EQUALS(a->els[pos].key, key)
-		    || (
-		    	#ifndef OAHT_NO_STORE_HASH
-		    	a->els[pos].hash == hash &&
-		    	#endif
-		        !OAHT_IS_DELETED_KEY(a->els[pos].key) &&
-		        OAHT_KEY_EQUALS(a->els[pos].key, key)
-		       )
-		   )
+		}
+		if (OAHT_NAME(_entry_matches)(&a->els[pos], key, hash)) {
+			OAHT_NAME(_count_lookup)(a, start, pos, 1);
 			return &a->els[pos];
-		if (OAHT_IS_DELETED_KEY(a->els[pos].key) && !freeslot)
+		}
+		#ifndef OAHT_CONCURRENT_READ
+		/* (a reader may still be looking at a DELETED slot's value) */
+		if (OAHT_IS_DELETED_SLOT(a->els[pos].key) && !freeslot)
 			freeslot = &a->els[pos];
+		#endif
 		pos = (pos + 1) & a->mask;
 	}
+	#endif
+}
+
+/*
+ * Check if the entry returned by _lookup_helper means that the key is not
+ * present in the table. Used internally.
+ */
+static inline int
+OAHT_NAME(_is_miss)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                    OAHT_HASH_T hash) {
+	#ifdef OAHT_ROBIN_HOOD
+	/* an entry where a lookup stopped early has a different hash */
+	return OAHT_IS_EMPTY_KEY(e->key) ||
+		OAHT_NAME(_get_hash_of_entry)(a, e) != hash;
+	#else
+	OAHT_KEY_T k = OAHT_NAME(_load_key)(e);
+	(void)a;
+	(void)hash;
+	return OAHT_IS_EMPTY_KEY(k) || OAHT_IS_DELETED_SLOT(k);
+	#endif
+}
+
+/*
+ * Prepares the entry returned by _lookup_helper for a missing key for
+ * inserting the key. With OAHT_ROBIN_HOOD, the entries from there on are
+ * moved further, each one taking the place of the first entry closer to its
+ * initial probe, and the slot is left EMPTY. Otherwise, this does nothing.
+ * Used internally.
+ */
+static inline struct OAHT_NAME(_entry) *
+OAHT_NAME(_make_room)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_ROBIN_HOOD
+	struct OAHT_NAME(_entry) carry, tmp;
+	#ifdef OAHT_SOA_VALUES
+	OAHT_VALUE_T carry_value, tmp_value;
+	#endif
+	OAHT_SIZE_T pos = (OAHT_SIZE_T)(e - a->els), dist, d;
+	if (OAHT_IS_EMPTY_KEY(e->key))
+		return e;
+	memcpy(&carry, e, sizeof(struct OAHT_NAME(_entry)));
+	#ifdef OAHT_SOA_VALUES
+	carry_value = *OAHT_NAME(_value_ptr)(a, e);
+	#endif
+	dist = OAHT_NAME(_probe_distance)(a, &carry, pos);
+	while (1) {
+		pos = (pos + 1) & a->mask;
+		dist++;
+		if (OAHT_IS_EMPTY_KEY(a->els[pos].key))
+			break;
+		d = OAHT_NAME(_probe_distance)(a, &a->els[pos], pos);
+		if (d < dist) {
+			memcpy(&tmp, &a->els[pos], sizeof(struct OAHT_NAME(_entry)));
+			memcpy(&a->els[pos], &carry, sizeof(struct OAHT_NAME(_entry)));
+			memcpy(&carry, &tmp, sizeof(struct OAHT_NAME(_entry)));
+			#ifdef OAHT_SOA_VALUES
+			tmp_value = *OAHT_NAME(_value_ptr)(a, &a->els[pos]);
+			*OAHT_NAME(_value_ptr)(a, &a->els[pos]) = carry_value;
+			carry_value = tmp_value;
+			#endif
+			dist = d;
+		}
+	}
+	memcpy(&a->els[pos], &carry, sizeof(struct OAHT_NAME(_entry)));
+	#ifdef OAHT_SOA_VALUES
+	*OAHT_NAME(_value_ptr)(a, &a->els[pos]) = carry_value;
+	#endif
+	e->key = OAHT_EMPTY_KEY;
+	#else
+	(void)a;
+	#endif
+	return e;
+}
+
+/*
+ * Removes the entry in a used slot, by marking it as DELETED or, with
+ * OAHT_BACKSHIFT_DELETE, by moving the following entries in the cluster back
+ * so that no DELETED slot is needed. The caller updates used, and fill with
+ * OAHT_BACKSHIFT_DELETE, so that entries in clusters separated by EMPTY slots
+ * can be removed by different threads. Returns 1 if another entry was moved to
+ * the slot, otherwise 0. Used internally.
+ */
+static inline int
+OAHT_NAME(_clear_entry)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	#ifdef OAHT_BACKSHIFT_DELETE
+	OAHT_SIZE_T i = (OAHT_SIZE_T)(e - a->els), j = i, h;
+	int moved = 0;
+	OAHT_NAME(_will_modify)(a, e, 1);
+	while (1) {
+		j = (j + 1) & a->mask;
+		if (OAHT_IS_EMPTY_KEY(a->els[j].key))
+			break;
+		/* the entry can't move if its initial probe is cyclically in (i, j] */
+		h = OAHT_NAME(_get_hash_of_entry)(a, &a->els[j]) & a->mask;
+		if (i <= j ? (i < h && h <= j) : (i < h || h <= j))
+			#ifdef OAHT_ROBIN_HOOD
+			break; /* and neither can the following ones */
+			#else
+			continue;
+			#endif
+		OAHT_NAME(_copy_entry)(a, &a->els[i], a, &a->els[j]);
+		OAHT_NAME(_sync_ctrl)(a, &a->els[i]);
+		i = j;
+		moved = 1;
+	}
+	a->els[i].key = OAHT_EMPTY_KEY;
+	OAHT_NAME(_sync_ctrl)(a, &a->els[i]);
+	return moved;
+	#else
+	OAHT_NAME(_will_modify)(a, e, 0);
+	OAHT_NAME(_store_key)(e, OAHT_DELETED_KEY);
+	OAHT_NAME(_sync_ctrl)(a, e);
+	return 0;
+	#endif
+}
+
+/* Like _clear_entry, also updating fill. Used internally. */
+static inline int
+OAHT_NAME(_remove_entry)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e) {
+	int moved = OAHT_NAME(_clear_entry)(a, e);
+	#ifdef OAHT_BACKSHIFT_DELETE
+	a->fill--;
+	#endif
+	return moved;
+}
+
+#ifdef OAHT_INCREMENTAL_RESIZE
+/*
+ * Moves the entries in up to n slots of the old table to the table. When the
+ * old table is empty, it is freed. Used internally.
+ */
+static inline void
+OAHT_NAME(_migrate)(struct OAHT_PREFIX *a, OAHT_SIZE_T n) {
+	struct OAHT_PREFIX *old = a->old;
+	if (!old)
+		return;
+	while (n > 0 && old->used > 0) {
+		struct OAHT_NAME(_entry) *eo = &old->els[a->migrated];
+		struct OAHT_NAME(_entry) *e;
+		n--;
+		if (OAHT_IS_EMPTY_KEY(eo->key) || OAHT_IS_DELETED_SLOT(eo->key)) {
+			a->migrated++;
+			continue;
+		}
+		e = OAHT_NAME(_lookup_helper)(a, eo->key, OAHT_NAME(_get_hash_of_entry)(old, eo));
+		e = OAHT_NAME(_make_room)(a, e);
+		if (OAHT_IS_EMPTY_KEY(e->key))
+			a->fill++;
+		OAHT_NAME(_copy_entry)(a, e, old, eo);
+		OAHT_NAME(_sync_ctrl)(a, e);
+		old->used--;
+		/*
+		 * Keep the probe sequences of the old table intact. If an entry was
+		 * moved back into the slot, it's migrated next. (The slots before
+		 * the migrated ones are EMPTY, so nothing is moved back past them.)
+		 */
+		if (!OAHT_NAME(_remove_entry)(old, eo))
+			a->migrated++;
+	}
+	if (old->used == 0) {
+		OAHT_FREE(old, OAHT_NAME(_sizeof)(old->mask));
+		a->old = NULL;
+		a->migrated = 0;
+	}
+}
+
+/*
+ * Moves all the entries of the old table to the table. A slot of the old table
+ * may be migrated more than once, when entries are moved back into it, so this
+ * repeats _migrate until the old table is freed. Used internally.
+ */
+static inline void
+OAHT_NAME(_finish_migration)(struct OAHT_PREFIX *a) {
+	while (a->old)
+		OAHT_NAME(_migrate)(a, a->old->mask + 1);
+}
+
+/*
+ * Deletes a key from the old table, if it is there. Returns 1 if it was
+ * deleted, otherwise 0. Used internally.
+ */
+static inline int
+OAHT_NAME(_delete_from_old)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	struct OAHT_NAME(_entry) *e =
+		OAHT_NAME(_lookup_helper)(a->old, key, hash);
+	if (OAHT_NAME(_is_miss)(a->old, e, hash))
+		return 0;
+	OAHT_NAME(_remove_entry)(a->old, e);
+	a->old->used--;
+	a->used--;
+	return 1;
+}
+#endif
+
+/*
+ * Finds the entry of a key, or returns NULL if the key is not present. During
+ * an incremental resize the old table is also searched, so the returned entry
+ * can be in either table and must not be used for inserting. If t is not NULL,
+ * it's set to the table of the entry. Used internally.
+ */
+static inline struct OAHT_NAME(_entry) *
+OAHT_NAME(_find)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash,
+                 struct OAHT_PREFIX **t) {
+	struct OAHT_NAME(_entry) *e = OAHT_NAME(_lookup_helper)(a, key, hash);
+	if (OAHT_NAME(_is_miss)(a, e, hash)) {
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		if (a->old) {
+			e = OAHT_NAME(_lookup_helper)(a->old, key, hash);
+			if (t)
+				*t = a->old;
+			return OAHT_NAME(_is_miss)(a->old, e, hash) ? NULL : e;
+		}
+		#endif
+		return NULL;
+	}
+	#ifdef OAHT_CONCURRENT_READ
+	/* the writer may have filled the EMPTY slot the lookup ended at */
+	if (!OAHT_NAME(_entry_matches)(e, key, hash))
+		return NULL;
+	#endif
+	if (t)
+		*t = a;
+	return e;
+}
+
+/*
+ * Rehash the entries within the same memory, turning all DELETED slots into
+ * EMPTY ones. The entries are in the first oldmask + 1 slots, which may be
+ * fewer than the slots of the table if it has just grown. Used internally.
+ */
+static inline void
+OAHT_NAME(_rehash_in_place)(struct OAHT_PREFIX *a, OAHT_SIZE_T oldmask) {
+	OAHT_SIZE_T start, n, i, pos;
+	a->fill = 0;
+	/*
+	 * Start after an EMPTY slot. A probe sequence never passes an EMPTY slot,
+	 * so the initial probe of every entry is at or after start. Each entry is
+	 * then only moved to slots which have already been rehashed or, if the
+	 * table has grown, to the new slots. (An entry moved to the new slots
+	 * never wraps around into the old slots not yet rehashed, since there are
+	 * fewer such entries than new slots after its initial probe.)
+	 */
+	for (start = 0; !OAHT_IS_EMPTY_KEY(a->els[start].key); start++);
+	for (i = 0; i <= oldmask; i++)
+		if (OAHT_IS_DELETED_SLOT(a->els[i].key)) {
+			a->els[i].key = OAHT_EMPTY_KEY;
+			OAHT_NAME(_sync_ctrl)(a, &a->els[i]);
+		}
+	for (n = 0; n <= oldmask; n++) {
+		struct OAHT_NAME(_entry) *e;
+		i = (start + 1 + n) & oldmask;
+		e = &a->els[i];
+		if (OAHT_IS_EMPTY_KEY(e->key))
+			continue;
+		a->fill++;
+		pos = OAHT_NAME(_get_hash_of_entry)(a, e) & a->mask;
+		while (pos != i && !OAHT_IS_EMPTY_KEY(a->els[pos].key))
+			pos = (pos + 1) & a->mask;
+		if (pos != i) {
+			OAHT_NAME(_copy_entry)(a, &a->els[pos], a, e);
+			e->key = OAHT_EMPTY_KEY;
+			OAHT_NAME(_sync_ctrl)(a, &a->els[pos]);
+			OAHT_NAME(_sync_ctrl)(a, e);
+		}
+	}
+}
+
+#if !defined(OAHT_INCREMENTAL_RESIZE) && !defined(OAHT_ROBIN_HOOD) && \
+    !defined(OAHT_CONCURRENT_READ)
+/*
+ * Grow the table using OAHT_REALLOC and rehash the entries within the same
+ * memory. The old and the new table then don't need to exist at the same time
+ * and realloc may be able to grow the memory without copying. Returns a
+ * pointer to the new memory. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_grow_in_place)(struct OAHT_PREFIX *a, OAHT_SIZE_T mask) {
+	OAHT_SIZE_T oldmask = a->mask;
+	a = (struct OAHT_PREFIX *)OAHT_REALLOC(a, OAHT_NAME(_sizeof)(mask),
+	                                       OAHT_NAME(_sizeof)(oldmask));
+	if (!a) OAHT_OOM();
+	a->mask = mask;
+	#ifdef OAHT_SOA_VALUES
+	/* the values move further, as they're stored after the entries */
+	memmove(OAHT_NAME(_values)(a),
+	        (char *)a + OAHT_NAME(_values_offset)(oldmask),
+	        (oldmask + 1) * sizeof(OAHT_VALUE_T));
+	#endif
+	#ifdef OAHT_EMPTY_KEY_BYTE
+	memset(&a->els[oldmask + 1], OAHT_EMPTY_KEY_BYTE,
+	       (mask - oldmask) * sizeof(struct OAHT_NAME(_entry)));
+	#else
+	{
+		OAHT_SIZE_T i;
+		for (i = oldmask + 1; i <= mask; i++)
+			a->els[i].key = OAHT_EMPTY_KEY;
+	}
+	#endif
+	#ifdef OAHT_CONTROL_BYTES
+	/* the control bytes have moved, as they're stored after the entries */
+	memset(OAHT_NAME(_ctrl)(a), OAHT_CTRL_EMPTY, mask + OAHT_GROUP_WIDTH);
+	{
+		OAHT_SIZE_T i;
+		for (i = 0; i <= oldmask; i++)
+			OAHT_NAME(_sync_ctrl)(a, &a->els[i]);
+	}
+	#endif
+	OAHT_NAME(_rehash_in_place)(a, oldmask);
+	return a;
+}
+#endif
+
+/*
+ * Allocate and copy the contents to a new memory area. Returns a pointer to
+ * the new memory. Used internally by _resize.
+ *
+ * When growing, the memory is reallocated and the entries are rehashed within
+ * it instead, and if the size is unchanged, the entries are just rehashed.
+ *
+ * With OAHT_INCREMENTAL_RESIZE, only the new memory is allocated. The entries
+ * are moved later by _migrate and the old memory is free'd when it's empty.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_resize_entries)(struct OAHT_PREFIX *a, OAHT_SIZE_T min_size) {
+	struct OAHT_PREFIX *b;
+	#ifndef OAHT_INCREMENTAL_RESIZE
+	OAHT_SIZE_T i;
+	#endif
+	#if !defined(OAHT_INCREMENTAL_RESIZE) && !defined(OAHT_ROBIN_HOOD) && \
+	    !defined(OAHT_CONCURRENT_READ)
+	OAHT_SIZE_T mask;
+	#endif
+	/* never make the table so small that it's full after the resize */
+	if (min_size < OAHT_NAME(_min_size)(a->used))
+		min_size = OAHT_NAME(_min_size)(a->used);
+	#if !defined(OAHT_INCREMENTAL_RESIZE) && !defined(OAHT_ROBIN_HOOD) && \
+	    !defined(OAHT_CONCURRENT_READ)
+	mask = OAHT_NAME(_mask_for)(min_size);
+	/*
+	 * Rehashing in place starts at an EMPTY slot, which a full small table
+	 * lacks, and relies on the initial probes of the entries, which a small
+	 * table doesn't use. A small table is copied instead.
+	 */
+	if (a->fill <= a->mask && !OAHT_NAME(_is_shared)(a) &&
+	    (!OAHT_NAME(_is_small)(a->mask) || OAHT_NAME(_is_small)(mask))) {
+		if (mask == a->mask) {
+			OAHT_NAME(_rehash_in_place)(a, a->mask);
+			return a;
+		}
+		if (mask > a->mask)
+			return OAHT_NAME(_grow_in_place)(a, mask);
+	}
+	#endif
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* finish the migration in progress, if any */
+	OAHT_NAME(_finish_migration)(a);
+	#endif
+	b = OAHT_NAME(_create_presized)(min_size);
+	#ifdef OAHT_HASH_FN
+	/* the stored hashes are kept */
+	b->seed = a->seed;
+	#endif
+	/* copy user-defined header data */
+	#ifdef OAHT_HEADER
+	memcpy(b, a, offsetof(struct OAHT_PREFIX, fill));
+	#endif
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	b->used = a->used;
+	b->old = a;
+	OAHT_NAME(_migrate)(b, OAHT_INCREMENTAL_STEP);
+	#else
+	/* set the used and fill values as they will be */
+	b->used = b->fill = a->used;
+	/* copy the entries */
+	for (i = 0; i <= a->mask; i++) {
+		struct OAHT_NAME(_entry) *ea = &a->els[i];
+		struct OAHT_NAME(_entry) *eb;
+		OAHT_HASH_T hash;
+		if (OAHT_IS_EMPTY_KEY(ea->key)
+		    || OAHT_IS_DELETED_SLOT(ea->key))
+			continue;
+		hash = OAHT_NAME(_get_hash_of_entry)(a, ea);
+		#ifdef OAHT_SMALL_SIZE
+		/* the hash is 0 in a small table */
+		if (OAHT_NAME(_is_small)(b->mask))
+			hash = 0;
+		else if (OAHT_NAME(_is_small)(a->mask))
+			hash = OAHT_NAME(_hash_of)(b, ea->key);
+		#endif
+		eb = OAHT_NAME(_lookup_helper)(b, ea->key, hash);
+		eb = OAHT_NAME(_make_room)(b, eb);
+		assert(OAHT_IS_EMPTY_KEY(eb->key));
+		OAHT_NAME(_copy_entry)(b, eb, a, ea);
+		#ifdef OAHT_SMALL_SIZE
+		eb->hash = hash;
+		#endif
+		OAHT_NAME(_sync_ctrl_h)(b, eb, hash);
+	}
+	#ifdef OAHT_CONCURRENT_READ
+	/* Readers may still use the old table. It's free'd by _reclaim. */
+	b->retired = a;
+	#else
+	/* Free the memory of the old table */
+	OAHT_NAME(_free_replaced)(a);
+	#endif
+	#endif
+	return b;
+}
+
+#ifdef OAHT_STATS
+/*
+ * Counts a resize, which started at t0, of a table with used entries and the
+ * counters c, and gives the counters to the resized table b. The lookups done
+ * by the resize itself are not counted. Used internally.
+ */
+static inline void
+OAHT_NAME(_count_resize)(struct OAHT_PREFIX *b, struct OAHT_NAME(_counters) *c,
+                         OAHT_SIZE_T used, unsigned long long t0) {
+	size_t entry_size = sizeof(struct OAHT_NAME(_entry));
+	#ifdef OAHT_SOA_VALUES
+	entry_size += sizeof(OAHT_VALUE_T);
+	#endif
+	c->resizes++;
+	c->moved_bytes += (unsigned long long)used * entry_size;
+	c->resize_clock += OAHT_STATS_CLOCK() - t0;
+	b->counters = *c;
+}
+#endif
+
+/*
+ * Resizes the table, see _resize_entries, and counts the resize if OAHT_STATS
+ * is defined. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_resize)(struct OAHT_PREFIX *a, OAHT_SIZE_T min_size) {
+	#ifdef OAHT_STATS
+	struct OAHT_NAME(_counters) c;
+	OAHT_SIZE_T used = a->used;
+	unsigned long long t0 = OAHT_STATS_CLOCK();
+	OAHT_NAME(_load_counters)(a, &c);
+	a = OAHT_NAME(_resize_entries)(a, min_size);
+	OAHT_NAME(_count_resize)(a, &c, used, t0);
+	return a;
+	#else
+	return OAHT_NAME(_resize_entries)(a, min_size);
+	#endif
+}
+
+#ifdef OAHT_PARALLEL_RESIZE
+/*
+ * The state of a parallel resize, shared by the tasks. The slots of both
+ * tables are split into n parts of equal size, n being a power of 2. Each
+ * entry belongs to the part of the new table where its initial probe is.
+ * Used internally.
+ */
+struct OAHT_NAME(_rehash_job) {
+	struct OAHT_PREFIX *a, *b;  /* the old and the new table */
+	unsigned n, phase;
+	unsigned ashift, bshift;    /* slot >> shift is the part of the slot */
+	OAHT_SIZE_T *offsets;       /* n * n, for each part of a and part of b */
+	OAHT_SIZE_T *start;         /* n + 1, the indices of each part of b */
+	OAHT_SIZE_T *deferred;      /* n, the number of entries left over */
+	OAHT_SIZE_T *idx;           /* the slots of a, grouped by part of b */
+};
+
+/*
+ * A task of a parallel resize. Phase 0 counts the entries in part i of the old
+ * table for each part of the new table, and phase 1 stores their slots in idx
+ * grouped by part of the new table. Phase 2 inserts the entries belonging to
+ * part i of the new table, except for those which would be placed beyond it;
+ * they are left for inserting afterwards. Used internally.
+ */
+static inline void
+OAHT_NAME(_rehash_task)(void *arg, unsigned i) {
+	struct OAHT_NAME(_rehash_job) *job = (struct OAHT_NAME(_rehash_job) *)arg;
+	struct OAHT_PREFIX *a = job->a, *b = job->b;
+	OAHT_SIZE_T pos, end, k;
+	if (job->phase < 2) {
+		OAHT_SIZE_T *offsets = &job->offsets[i * job->n];
+		end = ((OAHT_SIZE_T)i + 1) << job->ashift;
+		for (pos = (OAHT_SIZE_T)i << job->ashift; pos < end; pos++) {
+			struct OAHT_NAME(_entry) *e = &a->els[pos];
+			unsigned part;
+			if (OAHT_IS_EMPTY_KEY(e->key) || OAHT_IS_DELETED_SLOT(e->key))
+				continue;
+			part = (OAHT_NAME(_get_hash_of_entry)(a, e) & b->mask) >> job->bshift;
+			if (job->phase == 0)
+				offsets[part]++;
+			else
+				job->idx[offsets[part]++] = pos;
+		}
+		return;
+	}
+	end = ((OAHT_SIZE_T)i + 1) << job->bshift;
+	for (k = job->start[i]; k < job->start[i + 1]; k++) {
+		struct OAHT_NAME(_entry) *e = &a->els[job->idx[k]];
+		pos = OAHT_NAME(_get_hash_of_entry)(a, e) & b->mask;
+		while (pos < end && !OAHT_IS_EMPTY_KEY(b->els[pos].key))
+			pos++;
+		if (pos == end) {
+			/* it would be placed in the next part, so do it later */
+			job->idx[job->start[i] + job->deferred[i]++] = job->idx[k];
+			continue;
+		}
+		OAHT_NAME(_copy_entry)(b, &b->els[pos], a, e);
+		OAHT_NAME(_sync_ctrl)(b, &b->els[pos]);
+	}
+}
+
+/*
+ * Like _resize, but allocates a new table and rehashes the entries using
+ * nthreads threads, rounded down to a power of 2. This is faster for very
+ * large tables, but the old and the new table exist at the same time. Returns
+ * a pointer to the new memory. If the size doesn't change or parallel
+ * rehashing is not supported with the configuration, _resize is used.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_resize_parallel)(struct OAHT_PREFIX *a, OAHT_SIZE_T min_size,
+                            unsigned nthreads) {
+	#if defined(OAHT_INCREMENTAL_RESIZE) || defined(OAHT_ROBIN_HOOD)
+	(void)nthreads;
+	return OAHT_NAME(_resize)(a, min_size);
+	#else
+	struct OAHT_NAME(_rehash_job) job;
+	struct OAHT_PREFIX *b;
+	OAHT_SIZE_T used = a->used, i, r, sum;
+	unsigned n = 1, logn = 0, loga = 0, logb = 0;
+	#ifdef OAHT_STATS
+	struct OAHT_NAME(_counters) c;
+	unsigned long long t0 = OAHT_STATS_CLOCK();
+	#endif
+	if (min_size < OAHT_NAME(_min_size)(used))
+		min_size = OAHT_NAME(_min_size)(used);
+	if (nthreads < 2 || OAHT_NAME(_mask_for)(min_size) == a->mask ||
+	    OAHT_NAME(_is_small)(a->mask) ||
+	    OAHT_NAME(_is_small)(OAHT_NAME(_mask_for)(min_size)))
+		return OAHT_NAME(_resize)(a, min_size);
+	#ifdef OAHT_STATS
+	OAHT_NAME(_load_counters)(a, &c);
+	#endif
+	b = OAHT_NAME(_create_presized)(min_size);
+	#ifdef OAHT_HASH_FN
+	b->seed = a->seed;
+	#endif
+	while ((OAHT_SIZE_T)1 << loga <= a->mask)
+		loga++;
+	while ((OAHT_SIZE_T)1 << logb <= b->mask)
+		logb++;
+	/* at most one part per slot of the smaller table */
+	while (n * 2 <= nthreads && logn < loga && logn < logb) {
+		n *= 2;
+		logn++;
+	}
+	job.a = a;
+	job.b = b;
+	job.n = n;
+	job.ashift = loga - logn;
+	job.bshift = logb - logn;
+	job.offsets = (OAHT_SIZE_T *)OAHT_ALLOC(n * n * sizeof(OAHT_SIZE_T));
+	job.start = (OAHT_SIZE_T *)OAHT_ALLOC((n + 1) * sizeof(OAHT_SIZE_T));
+	job.deferred = (OAHT_SIZE_T *)OAHT_ALLOC(n * sizeof(OAHT_SIZE_T));
+	job.idx = (OAHT_SIZE_T *)OAHT_ALLOC((used + 1) * sizeof(OAHT_SIZE_T));
+	if (!job.offsets || !job.start || !job.deferred || !job.idx) OAHT_OOM();
+	memset(job.offsets, 0, n * n * sizeof(OAHT_SIZE_T));
+	memset(job.deferred, 0, n * sizeof(OAHT_SIZE_T));
+	job.phase = 0;
+	OAHT_PARALLEL_FOR(n, OAHT_NAME(_rehash_task), &job);
+	/* turn the counts into offsets in idx, grouped by part of b */
+	for (sum = 0, r = 0; r < n; r++) {
+		job.start[r] = sum;
+		for (i = 0; i < n; i++) {
+			OAHT_SIZE_T count = job.offsets[i * n + r];
+			job.offsets[i * n + r] = sum;
+			sum += count;
+		}
+	}
+	job.start[n] = sum;
+	job.phase = 1;
+	OAHT_PARALLEL_FOR(n, OAHT_NAME(_rehash_task), &job);
+	job.phase = 2;
+	OAHT_PARALLEL_FOR(n, OAHT_NAME(_rehash_task), &job);
+	/* the entries which didn't fit in their parts */
+	for (r = 0; r < n; r++) {
+		for (i = job.start[r]; i < job.start[r] + job.deferred[r]; i++) {
+			struct OAHT_NAME(_entry) *e = &a->els[job.idx[i]];
+			OAHT_SIZE_T pos = OAHT_NAME(_get_hash_of_entry)(a, e) & b->mask;
+			while (!OAHT_IS_EMPTY_KEY(b->els[pos].key))
+				pos = (pos + 1) & b->mask;
+			OAHT_NAME(_copy_entry)(b, &b->els[pos], a, e);
+			OAHT_NAME(_sync_ctrl)(b, &b->els[pos]);
+		}
+	}
+	OAHT_FREE(job.offsets, n * n * sizeof(OAHT_SIZE_T));
+	OAHT_FREE(job.start, (n + 1) * sizeof(OAHT_SIZE_T));
+	OAHT_FREE(job.deferred, n * sizeof(OAHT_SIZE_T));
+	OAHT_FREE(job.idx, (used + 1) * sizeof(OAHT_SIZE_T));
+	#ifdef OAHT_HEADER
+	memcpy(b, a, offsetof(struct OAHT_PREFIX, fill));
+	#endif
+	b->used = b->fill = used;
+	#ifdef OAHT_STATS
+	OAHT_NAME(_count_resize)(b, &c, used, t0);
+	#endif
+	#ifdef OAHT_CONCURRENT_READ
+	b->retired = a;
+	#else
+	OAHT_NAME(_free_replaced)(a);
+	#endif
+	return b;
+	#endif
+}
+#endif
+
+/* Check if the table is mostly unused and should shrink. Used internally. */
+static inline int
+OAHT_NAME(_should_shrink)(struct OAHT_PREFIX *a) {
+	return a->mask + 1 > OAHT_MIN_CAPACITY &&
+		a->used * OAHT_MIN_LOAD_DEN < (a->mask + 1) * OAHT_MIN_LOAD_NUM;
+}
+
+/*
+ * Turns all DELETED slots into EMPTY ones. With OAHT_CONCURRENT_READ or if
+ * snapshots are reading the table, the entries are copied to a new table of
+ * the same size instead. Returns a pointer to the table. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_purge)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_CONCURRENT_READ
+	return OAHT_NAME(_resize)(a, a->mask + 1);
+	#else
+	if (OAHT_NAME(_is_shared)(a))
+		return OAHT_NAME(_resize)(a, a->mask + 1);
+	OAHT_NAME(_rehash_in_place)(a, a->mask);
+	return a;
+	#endif
+}
+
+/*
+ * Called after a delete to shrink the table if it's mostly unused or to remove
+ * the DELETED slots if there are too many of them. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_after_delete)(struct OAHT_PREFIX *a) {
+	OAHT_SIZE_T used = a->used; /* the entries in this table's own slots */
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		used -= a->old->used;
+	#endif
+	/* don't shrink during an incremental resize */
+	if (used == a->used && OAHT_NAME(_should_shrink)(a))
+		return OAHT_NAME(_resize)(a, 2 * a->used);
+	if ((a->fill - used) * OAHT_MAX_DELETED_DEN >=
+	    (a->mask + 1) * OAHT_MAX_DELETED_NUM)
+		return OAHT_NAME(_purge)(a);
+	return a;
+}
+
+/*
+ * Remove all DELETED slots and shrink the table if it's mostly unused. This
+ * is done automatically by delete, but may be called explicitly, e.g. in quiet
+ * periods. Returns a pointer to the same memory location or to a new memory
+ * location if the memory has been reallocated. (If the hash tables has been
+ * reallocated, the old memory has been free'd.)
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_compact)(struct OAHT_PREFIX *a) {
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_finish_migration)(a);
+	#endif
+	if (OAHT_NAME(_should_shrink)(a)) {
+		a = OAHT_NAME(_resize)(a, 2 * a->used);
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		OAHT_NAME(_finish_migration)(a);
+		#endif
+	} else if (a->fill > a->used) {
+		a = OAHT_NAME(_purge)(a);
+	}
+	return a;
+}
+
+/*
+ * Hashes n <= OAHT_BATCH_SIZE keys and prefetches their initial probes. Used
+ * internally.
+ */
+static inline void
+OAHT_NAME(_prefetch_batch)(struct OAHT_PREFIX *a, OAHT_KEY_T const *keys,
+                           OAHT_HASH_T *hashes, OAHT_SIZE_T n) {
+	OAHT_SIZE_T i;
+	for (i = 0; i < n; i++) {
+		hashes[i] = OAHT_NAME(_hash_of)(a, keys[i]);
+		OAHT_PREFETCH(&a->els[hashes[i] & a->mask]);
+		#ifdef OAHT_CONTROL_BYTES
+		OAHT_PREFETCH(OAHT_NAME(_ctrl)(a) + (hashes[i] & a->mask));
+		#endif
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		if (a->old)
+			OAHT_PREFETCH(&a->old->els[hashes[i] & a->old->mask]);
+		#endif
+	}
+}
+
+/*
+ * Check if a key with the given hash, as returned by _hash, exists. Returns 1
+ * if it does, 0 if it doesn't.
+ */
+static inline int
+OAHT_NAME(_contains_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	struct OAHT_NAME(_entry) *e;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	e = OAHT_NAME(_find)(a, key, OAHT_NAME(_hash_given)(a, hash), NULL);
+	return e != NULL;
+}
+
+/*
+ * Check if a key exists. Returns 1 if it does, 0 if it doesn't.
+ */
+static inline int
+OAHT_NAME(_contains)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	return OAHT_NAME(_contains_h)(a, key, OAHT_NAME(_hash_of)(a, key));
+}
+
+/*
+ * Check if each of the n keys exists. Sets out[i] to 1 if keys[i] exists and
+ * to 0 if it doesn't. The lookups of many keys are overlapped, which is faster
+ * than calling contains for each key when the table doesn't fit in the
+ * cache. Returns the number of keys that exist.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_contains_many)(struct OAHT_PREFIX *a, OAHT_KEY_T const *keys,
+                          OAHT_SIZE_T n, int *out) {
+	OAHT_HASH_T hashes[OAHT_BATCH_SIZE];
+	OAHT_SIZE_T i, j, m, found = 0;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	for (i = 0; i < n; i += m) {
+		m = n - i < OAHT_BATCH_SIZE ? n - i : OAHT_BATCH_SIZE;
+		OAHT_NAME(_prefetch_batch)(a, keys + i, hashes, m);
+		for (j = 0; j < m; j++) {
+			struct OAHT_NAME(_entry) *e =
+				OAHT_NAME(_find)(a, keys[i + j], hashes[j], NULL);
+			out[i + j] = e != NULL;
+			found += out[i + j];
+		}
+	}
+	return found;
+}
+
+/*
+ * Insert the key if it's not present, given the entry returned by
+ * _lookup_helper for it, and store the value, unless value is NULL. The key is
+ * written last, so that a concurrent reader which finds it also finds the
+ * value. If inserted is not NULL, it's set to 1 if the key was inserted and to
+ * 0 if it was already present. Returns the entry of the key. The table is not
+ * resized, so the caller needs to check the fill afterwards. Used internally.
+ */
+static inline struct OAHT_NAME(_entry) *
+OAHT_NAME(_put_at)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *entry,
+                   OAHT_KEY_T key, OAHT_HASH_T hash, OAHT_VALUE_T const *value,
+                   int *inserted) {
+	int found = !OAHT_NAME(_is_miss)(a, entry, hash);
+	#ifdef OAHT_ROBIN_HOOD
+	/* the entries from there on may be moved by _make_room */
+	OAHT_NAME(_will_modify)(a, entry, !found);
+	#else
+	OAHT_NAME(_will_modify)(a, entry, 0);
+	#endif
+	if (!found) {
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		/* an old entry is moved to the new table by deleting and inserting it */
+		if (a->old)
+			found = OAHT_NAME(_delete_from_old)(a, key, hash);
+		#endif
+		entry = OAHT_NAME(_make_room)(a, entry);
+		if (OAHT_IS_EMPTY_KEY(entry->key))
+			a->fill++;
+		a->used++;
+		#ifndef OAHT_NO_STORE_HASH
+		entry->hash = hash;
+		#endif
+	}
+	#ifndef OAHT_NO_VALUE
+	if (value)
+		OAHT_NAME(_store_value)(a, entry, value);
+	#else
+	(void)value;
+	#endif
+	OAHT_NAME(_store_key)(entry, key);
+	OAHT_NAME(_sync_ctrl_h)(a, entry, hash);
+	if (inserted)
+		*inserted = !found;
+	return entry;
+}
+
+/*
+ * Lookup the key and insert it if it's not present, and store the value, as
+ * _put_at does. Used internally.
+ */
+static inline void
+OAHT_NAME(_put)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash,
+                OAHT_VALUE_T const *value, int *inserted) {
+	OAHT_NAME(_put_at)(a, OAHT_NAME(_lookup_helper)(a, key, hash), key, hash,
+	                   value, inserted);
+}
+
+/* Called after an insert to resize the table if needed. Used internally. */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_after_insert)(struct OAHT_PREFIX *a) {
+	if (OAHT_NAME(_is_overloaded)(a->fill, a->mask)) {
+		#ifdef OAHT_SMALL_SIZE
+		/* a small table grows to the largest small size first */
+		if (a->mask + 1 < OAHT_SMALL_SIZE)
+			return OAHT_NAME(_resize)(a, OAHT_SMALL_SIZE);
+		#endif
+		#if defined(OAHT_PARALLEL_RESIZE) && defined(OAHT_RESIZE_THREADS)
+		if (a->used >= OAHT_PARALLEL_MIN_USED)
+			return OAHT_NAME(_resize_parallel)(a,
+				OAHT_GROWTH_FACTOR(a->used) * a->used, OAHT_RESIZE_THREADS);
+		#endif
+		return OAHT_NAME(_resize)(a, OAHT_GROWTH_FACTOR(a->used) * a->used);
+	}
+	return a;
+}
+
+/*
+ * Resizes the table if needed, so that n more entries can be inserted without
+ * resizing. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_make_space)(struct OAHT_PREFIX *a, OAHT_SIZE_T n) {
+	OAHT_SIZE_T fill = a->fill + n, used = a->used + n;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* the entries of the old table will be moved here too */
+	if (a->old)
+		fill += a->old->used;
+	#endif
+	if (OAHT_NAME(_is_overloaded)(fill, a->mask))
+		return OAHT_NAME(_resize)(a, OAHT_NAME(_min_size)(used));
+	return a;
+}
+
+/*
+ * Makes room for n entries in total, so that they can be inserted without
+ * resizing the table. Returns a pointer to the same memory location or to a
+ * new memory location if the memory has been reallocated. (If the hash
+ * tables has been reallocated, the old memory has been free'd.)
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_reserve)(struct OAHT_PREFIX *a, OAHT_SIZE_T n) {
+	return OAHT_NAME(_make_space)(a, n > a->used ? n - a->used : 0);
+}
+
+/*
+ * An entry read by _build_from, with its hash. The records are sorted by
+ * their initial probes before they're inserted. Used internally.
+ */
+struct OAHT_NAME(_build_rec) {
+	OAHT_HASH_T hash;
+	OAHT_KEY_T key;
+	#ifndef OAHT_NO_VALUE
+	OAHT_VALUE_T value;
+	#endif
+};
+
+/* The digit of a record's initial probe at shift. Used internally. */
+static inline unsigned
+OAHT_NAME(_build_digit)(const struct OAHT_NAME(_build_rec) *r,
+                        OAHT_SIZE_T mask, unsigned shift, unsigned bits) {
+	return (unsigned)((r->hash & mask) >> shift) & ((1u << bits) - 1);
+}
+
+/*
+ * Sorts the n records in r by the bits of their initial probes from
+ * OAHT_BUILD_WINDOW_BITS and up, one digit at a time from the lowest (a least
+ * significant digit radix sort), moving them between r and tmp. The digits
+ * have been counted in count. Afterwards, the initial probes of consecutive
+ * records are within a window of 2^OAHT_BUILD_WINDOW_BITS slots, where the
+ * inserts stay in the cache. Returns r or tmp, whichever holds the sorted
+ * records. Used internally.
+ */
+static inline struct OAHT_NAME(_build_rec) *
+OAHT_NAME(_build_sort)(struct OAHT_NAME(_build_rec) *r,
+                       struct OAHT_NAME(_build_rec) *tmp, size_t n,
+                       OAHT_SIZE_T mask, unsigned digits, unsigned bits,
+                       size_t count[][256]) {
+	unsigned p, d;
+	size_t i;
+	for (p = 0; p < digits; p++) {
+		unsigned shift = OAHT_BUILD_WINDOW_BITS + p * bits;
+		struct OAHT_NAME(_build_rec) *x;
+		size_t sum = 0;
+		for (d = 0; d < 256; d++) {
+			size_t c = count[p][d];
+			count[p][d] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++)
+			tmp[count[p][OAHT_NAME(_build_digit)(&r[i], mask, shift, bits)]++] =
+				r[i];
+		x = r;
+		r = tmp;
+		tmp = x;
+	}
+	return r;
+}
+
+/*
+ * Builds a table of the n entries returned by next, which is called with arg
+ * until it returns 0 or n entries have been read. The table is sized once and
+ * the entries are sorted by their initial probes before they're inserted, so
+ * that the table is written almost sequentially. This is faster than calling
+ * set for each entry when the table doesn't fit in the cache, but needs
+ * temporary memory for twice the n entries and their hashes. If a key occurs
+ * more than once, which of its values is kept is unspecified.
+ */
+static inline struct OAHT_PREFIX *
+#ifndef OAHT_NO_VALUE
+OAHT_NAME(_build_from)(int (*next)(void *arg, OAHT_KEY_T *key,
+                                   OAHT_VALUE_T *value),
+                       void *arg, OAHT_SIZE_T n) {
+#else
+OAHT_NAME(_build_from)(int (*next)(void *arg, OAHT_KEY_T *key),
+                       void *arg, OAHT_SIZE_T n) {
+#endif
+	struct OAHT_PREFIX *a =
+		OAHT_NAME(_create_presized)(OAHT_NAME(_min_size)(n));
+	struct OAHT_NAME(_build_rec) *r, *sorted;
+	size_t count[sizeof(OAHT_SIZE_T)][256];
+	size_t size;
+	OAHT_SIZE_T m, i;
+	unsigned span = 0, digits, bits = 0, p;
+	/* the probe bits above the window are sorted in digits of up to 8 bits */
+	while ((OAHT_SIZE_T)1 << span <= a->mask)
+		span++;
+	span = span > OAHT_BUILD_WINDOW_BITS ? span - OAHT_BUILD_WINDOW_BITS : 0;
+	digits = (span + 7) / 8;
+	if (digits)
+		bits = (span + digits - 1) / digits;
+	size = (size_t)(digits ? 2 : 1) * n *
+	       sizeof(struct OAHT_NAME(_build_rec));
+	r = (struct OAHT_NAME(_build_rec) *)OAHT_ALLOC(size);
+	if (!r && n > 0) OAHT_OOM();
+	memset(count, 0, sizeof(count));
+	for (m = 0; m < n; m++) {
+		#ifndef OAHT_NO_VALUE
+		if (!next(arg, &r[m].key, &r[m].value))
+			break;
+		#else
+		if (!next(arg, &r[m].key))
+			break;
+		#endif
+		r[m].hash = OAHT_NAME(_hash_of)(a, r[m].key);
+		for (p = 0; p < digits; p++)
+			count[p][OAHT_NAME(_build_digit)(&r[m], a->mask,
+			                                 OAHT_BUILD_WINDOW_BITS + p * bits,
+			                                 bits)]++;
+	}
+	sorted = OAHT_NAME(_build_sort)(r, r + n, m, a->mask, digits, bits, count);
+	for (i = 0; i < m; i++) {
+		#ifndef OAHT_NO_VALUE
+		OAHT_NAME(_put)(a, sorted[i].key, sorted[i].hash, &sorted[i].value,
+		                NULL);
+		#else
+		OAHT_NAME(_put)(a, sorted[i].key, sorted[i].hash, NULL, NULL);
+		#endif
+	}
+	OAHT_FREE(r, size);
+	return a;
+}
+
+#ifndef OAHT_NO_VALUE
+/* The hashtable has values. Provide get and set functions. */
+
+/*
+ * Fetch a value by its key and its hash, as returned by _hash. If it's not
+ * defined, default_value is returned.
+ */
+static inline OAHT_VALUE_T
+OAHT_NAME(_get_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash,
+                  OAHT_VALUE_T default_value) {
+	struct OAHT_NAME(_entry) *entry;
+	struct OAHT_PREFIX *t;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	entry = OAHT_NAME(_find)(a, key, OAHT_NAME(_hash_given)(a, hash), &t);
+	return entry ? OAHT_NAME(_load_value)(t, entry) : default_value;
+}
+
+/*
+ * Fetch a value by its key. If it's not defined, default_value is returned.
+ */
+static inline OAHT_VALUE_T
+OAHT_NAME(_get)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_VALUE_T default_value) {
+	return OAHT_NAME(_get_h)(a, key, OAHT_NAME(_hash_of)(a, key),
+	                         default_value);
+}
+
+/*
+ * Fetch the values of n keys. Sets values[i] to the value of keys[i] or to
+ * default_value if it's not defined. The lookups of many keys are overlapped,
+ * which is faster than calling get for each key when the table doesn't fit in
+ * the cache. Returns the number of keys that were found.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_get_many)(struct OAHT_PREFIX *a, OAHT_KEY_T const *keys,
+                     OAHT_SIZE_T n, OAHT_VALUE_T *values,
+                     OAHT_VALUE_T default_value) {
+	OAHT_HASH_T hashes[OAHT_BATCH_SIZE];
+	OAHT_SIZE_T i, j, m, found = 0;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	for (i = 0; i < n; i += m) {
+		m = n - i < OAHT_BATCH_SIZE ? n - i : OAHT_BATCH_SIZE;
+		OAHT_NAME(_prefetch_batch)(a, keys + i, hashes, m);
+		for (j = 0; j < m; j++) {
+			struct OAHT_PREFIX *t;
+			struct OAHT_NAME(_entry) *e =
+				OAHT_NAME(_find)(a, keys[i + j], hashes[j], &t);
+			if (!e) {
+				values[i + j] = default_value;
+			} else {
+				values[i + j] = OAHT_NAME(_load_value)(t, e);
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+/*
+ * Insert or replace the element at the given key, with its hash as returned
+ * by _hash. Returns the table, like set.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_set_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash,
+                  OAHT_VALUE_T value) {
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	OAHT_NAME(_put)(a, key, OAHT_NAME(_hash_given)(a, hash), &value, NULL);
+	return OAHT_NAME(_after_insert)(a);
+}
+
+/*
+ * Insert or replace the element at the given key. Returns a pointer to the same
+ * memory location or to a new memory location if the memory has been
+ * reallocated. (If the hash tables has been reallocated, the old memory has
+ * been free'd.)
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_set)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_VALUE_T value) {
+	return OAHT_NAME(_set_h)(a, key, OAHT_NAME(_hash_of)(a, key), value);
+}
+
+/*
+ * Insert or replace n elements, keys[i] with values[i]. The table is resized
+ * at most once, before inserting, and the keys are prefetched in batches. If
+ * inserted is not NULL, inserted[i] is set to 1 if keys[i] was inserted and
+ * to 0 if its value was replaced. Returns a pointer to the same memory
+ * location or to a new memory location if the memory has been reallocated, as
+ * set does.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_set_many)(struct OAHT_PREFIX *a, OAHT_KEY_T const *keys,
+                     OAHT_VALUE_T const *values, OAHT_SIZE_T n,
+                     int *inserted) {
+	OAHT_HASH_T hashes[OAHT_BATCH_SIZE];
+	OAHT_SIZE_T i, j, m;
+	a = OAHT_NAME(_make_space)(a, n);
+	for (i = 0; i < n; i += m) {
+		m = n - i < OAHT_BATCH_SIZE ? n - i : OAHT_BATCH_SIZE;
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		OAHT_NAME(_migrate)(a, m * OAHT_INCREMENTAL_STEP);
+		#endif
+		OAHT_NAME(_prefetch_batch)(a, keys + i, hashes, m);
+		for (j = 0; j < m; j++)
+			OAHT_NAME(_put)(a, keys[i + j], hashes[j], &values[i + j],
+			                inserted ? &inserted[i + j] : NULL);
+	}
+	return a;
+}
+
+/* Like get_ptr, given the hash of the key as returned by _hash. */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_get_ptr_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	struct OAHT_NAME(_entry) *entry;
+	struct OAHT_PREFIX *t;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	entry = OAHT_NAME(_find)(a, key, OAHT_NAME(_hash_given)(a, hash), &t);
+	if (!entry)
+		return NULL;
+	/* the value may be modified through the pointer */
+	OAHT_NAME(_will_modify)(t, entry, 0);
+	return OAHT_NAME(_value_ptr)(t, entry);
+}
+
+/*
+ * Returns a pointer to the value of a key in the table, or NULL if it's not
+ * present. The pointer is valid until the table is modified. With
+ * OAHT_INCREMENTAL_RESIZE, lookups modify the table too, by moving entries to
+ * the new table.
+ */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_get_ptr)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	return OAHT_NAME(_get_ptr_h)(a, key, OAHT_NAME(_hash_of)(a, key));
+}
+
+/*
+ * Finds or inserts a key in the table t, which has room for it, for upsert.
+ * Used internally.
+ */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_upsert_at)(struct OAHT_PREFIX *t, OAHT_KEY_T key, OAHT_HASH_T hash,
+                      int *inserted) {
+	struct OAHT_NAME(_entry) *entry;
+	OAHT_VALUE_T value;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	struct OAHT_NAME(_entry) *old;
+	OAHT_NAME(_migrate)(t, OAHT_INCREMENTAL_STEP);
+	#endif
+	entry = OAHT_NAME(_lookup_helper)(t, key, hash);
+	if (!OAHT_NAME(_is_miss)(t, entry, hash)) {
+		if (inserted)
+			*inserted = 0;
+		OAHT_NAME(_will_modify)(t, entry, 0);
+		return OAHT_NAME(_value_ptr)(t, entry);
+	}
+	memset(&value, 0, sizeof(value));
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* an entry of the old table is moved to the new table with its value */
+	if (t->old) {
+		old = OAHT_NAME(_lookup_helper)(t->old, key, hash);
+		if (!OAHT_NAME(_is_miss)(t->old, old, hash))
+			value = OAHT_NAME(_load_value)(t->old, old);
+	}
+	#endif
+	entry = OAHT_NAME(_put_at)(t, entry, key, hash, &value, inserted);
+	return OAHT_NAME(_value_ptr)(t, entry);
+}
+
+/*
+ * Find or insert a key. Returns a pointer to its value, which is set to all
+ * zero bits if the key is inserted, so that e.g. a counter can be incremented
+ * using a single lookup. *a is set to the table, which may have been resized
+ * before inserting, as set does. If inserted is not NULL, it's set to 1 if the
+ * key was inserted and to 0 if it was present. The pointer is valid until the
+ * table is modified, as for get_ptr. With OAHT_CONCURRENT_READ, the value must
+ * not be modified through the pointer while readers may read it.
+ */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_upsert)(struct OAHT_PREFIX **a, OAHT_KEY_T key, int *inserted) {
+	struct OAHT_PREFIX *t = *a = OAHT_NAME(_make_space)(*a, 1);
+	return OAHT_NAME(_upsert_at)(t, key, OAHT_NAME(_hash_of)(t, key),
+	                             inserted);
+}
+
+/* Like upsert, given the hash of the key as returned by _hash. */
+static inline OAHT_VALUE_T *
+OAHT_NAME(_upsert_h)(struct OAHT_PREFIX **a, OAHT_KEY_T key, OAHT_HASH_T hash,
+                     int *inserted) {
+	struct OAHT_PREFIX *t = *a = OAHT_NAME(_make_space)(*a, 1);
+	return OAHT_NAME(_upsert_at)(t, key, OAHT_NAME(_hash_given)(t, hash),
+	                             inserted);
+}
+
+#else
+/* The hash table is a set. Provide an add function instead of get and set. */
+
+/* Add a key with the given hash, as returned by _hash, to the set, like add. */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_add_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	OAHT_NAME(_put)(a, key, OAHT_NAME(_hash_given)(a, hash), NULL, NULL);
+	return OAHT_NAME(_after_insert)(a);
+}
+
+/*
+ * Add an element (key) to the set. Returns a pointer to the same
+ * memory location or to a new memory location if the memory has been
+ * reallocated. (If the hash tables has been reallocated, the old memory has
+ * been free'd.)
+ *
+ * (This is identical to the set function except there is no value.)
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_add)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	return OAHT_NAME(_add_h)(a, key, OAHT_NAME(_hash_of)(a, key));
+}
+
+/*
+ * Add n elements (keys) to the set. If inserted is not NULL, inserted[i] is
+ * set to 1 if keys[i] was added and to 0 if it already existed. Otherwise
+ * like set_many.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_add_many)(struct OAHT_PREFIX *a, OAHT_KEY_T const *keys,
+                     OAHT_SIZE_T n, int *inserted) {
+	OAHT_HASH_T hashes[OAHT_BATCH_SIZE];
+	OAHT_SIZE_T i, j, m;
+	a = OAHT_NAME(_make_space)(a, n);
+	for (i = 0; i < n; i += m) {
+		m = n - i < OAHT_BATCH_SIZE ? n - i : OAHT_BATCH_SIZE;
+		#ifdef OAHT_INCREMENTAL_RESIZE
+		OAHT_NAME(_migrate)(a, m * OAHT_INCREMENTAL_STEP);
+		#endif
+		OAHT_NAME(_prefetch_batch)(a, keys + i, hashes, m);
+		for (j = 0; j < m; j++)
+			OAHT_NAME(_put)(a, keys[i + j], hashes[j], NULL,
+			                inserted ? &inserted[i + j] : NULL);
+	}
+	return a;
+}
+
+#endif
+
+/*
+ * Delete the key with the given hash, as returned by _hash, from the hashtable.
+ * Returns the table, like delete.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_delete_h)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_HASH_T hash) {
+	struct OAHT_NAME(_entry) *entry;
+	hash = OAHT_NAME(_hash_given)(a, hash);
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	OAHT_NAME(_migrate)(a, OAHT_INCREMENTAL_STEP);
+	#endif
+	entry = OAHT_NAME(_lookup_helper)(a, key, hash);
+	if (!OAHT_NAME(_is_miss)(a, entry, hash)) {
+		OAHT_NAME(_remove_entry)(a, entry);
+		a->used--;
+		return OAHT_NAME(_after_delete)(a);
+	}
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	else if (a->old)
+		OAHT_NAME(_delete_from_old)(a, key, hash);
+	#endif
+	return a;
+}
+
+/*
+ * Delete the given key from the hashtable. Returns a pointer to the same
+ * memory location or to a new memory location if the memory has been
+ * reallocated. (If the hash tables has been reallocated, the old memory has
+ * been free'd.)
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_delete)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
+	return OAHT_NAME(_delete_h)(a, key, OAHT_NAME(_hash_of)(a, key));
+}
+
+/*
+ * Iteration and bulk deletion by ranges of positions, as returned by _next:
+ * the slots of the table followed, during an incremental resize, by the slots
+ * of the old table. Different ranges can be given to different threads.
+ * With OAHT_PARALLEL_RESIZE, _for_each_parallel and _retain_parallel split
+ * the positions into ranges and start the threads using OAHT_PARALLEL_FOR.
+ */
+
+/*
+ * Returns the number of positions of the table, the end of the last range for
+ * _for_each_range.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_slots)(struct OAHT_PREFIX *a) {
+	OAHT_SIZE_T end = a->mask + 1;
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		end += a->old->mask + 1;
+	#endif
+	return end;
+}
+
+/*
+ * Calls fn for each entry in the positions from begin to end - 1, with
+ * pointers to its key and value in the table. fn may modify the value but not
+ * the table. When OAHT_NO_VALUE is defined, fn has no value argument.
+ */
+static inline void
+OAHT_NAME(_for_each_range)(struct OAHT_PREFIX *a, OAHT_SIZE_T begin,
+                           OAHT_SIZE_T end,
+#ifndef OAHT_NO_VALUE
+                           void (*fn)(void *arg, OAHT_KEY_T const *key,
+                                      OAHT_VALUE_T *value),
+#else
+                           void (*fn)(void *arg, OAHT_KEY_T const *key),
+#endif
+                           void *arg) {
+	struct OAHT_NAME(_entry) *e;
+	OAHT_SIZE_T pos = begin;
+	/* the returned pos is past the entry */
+	while (pos < end && (e = OAHT_NAME(_next)(a, &pos)) && pos <= end) {
+		#ifndef OAHT_NO_VALUE
+		fn(arg, &e->key, OAHT_NAME(_entry_value)(a, e));
+		#else
+		fn(arg, &e->key);
+		#endif
+	}
+}
+
+/* Calls keep for the entry e of the table t. Used internally. */
+static inline int
+OAHT_NAME(_keeps)(struct OAHT_PREFIX *t, struct OAHT_NAME(_entry) *e,
+#ifndef OAHT_NO_VALUE
+                  int (*keep)(void *, OAHT_KEY_T const *, OAHT_VALUE_T *),
+#else
+                  int (*keep)(void *, OAHT_KEY_T const *),
+#endif
+                  void *arg) {
+	#ifndef OAHT_NO_VALUE
+	return keep(arg, &e->key, OAHT_NAME(_value_ptr)(t, e));
+	#else
+	(void)t;
+	return keep(arg, &e->key);
+	#endif
+}
+
+/*
+ * Returns the first position from pos, counting on from the last slot to the
+ * first one, of an EMPTY slot of t. There always is one. Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_empty_from)(struct OAHT_PREFIX *t, OAHT_SIZE_T pos) {
+	while (!OAHT_IS_EMPTY_KEY(t->els[pos & t->mask].key))
+		pos++;
+	return pos;
+}
+
+/*
+ * Removes the entries for which keep returns 0 in the slots begin to end - 1
+ * of t, counting on from the last slot to the first one. The slots before
+ * begin and at end must be EMPTY: an entry is then only moved back by
+ * OAHT_BACKSHIFT_DELETE within the range, to a slot not yet checked or to the
+ * one being checked, so keep is called once per entry. Returns the number of
+ * entries removed. The caller updates used and fill. Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_retain_slots)(struct OAHT_PREFIX *t, OAHT_SIZE_T begin,
+                         OAHT_SIZE_T end,
+#ifndef OAHT_NO_VALUE
+                         int (*keep)(void *, OAHT_KEY_T const *,
+                                     OAHT_VALUE_T *),
+#else
+                         int (*keep)(void *, OAHT_KEY_T const *),
+#endif
+                         void *arg) {
+	OAHT_SIZE_T pos, n = 0;
+	for (pos = begin; pos < end; pos++) {
+		struct OAHT_NAME(_entry) *e = &t->els[pos & t->mask];
+		while (!OAHT_IS_EMPTY_KEY(e->key) &&
+		       !OAHT_IS_DELETED_SLOT(e->key) &&
+		       !OAHT_NAME(_keeps)(t, e, keep, arg)) {
+			OAHT_NAME(_clear_entry)(t, e);
+			n++;
+		}
+	}
+	return n;
+}
+
+/*
+ * Updates used and fill after n entries were removed from t, which is a or
+ * its old table. Used internally.
+ */
+static inline void
+OAHT_NAME(_count_removed)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *t,
+                          OAHT_SIZE_T n) {
+	#ifdef OAHT_BACKSHIFT_DELETE
+	t->fill -= n;
+	#endif
+	if (t != a)
+		t->used -= n;
+	a->used -= n;
+}
+
+/*
+ * Removes the entries for which keep returns 0, in one pass over the slots
+ * without looking up the keys. keep is called once for each entry, with
+ * pointers to its key and value in the table, and must not modify the table.
+ * When OAHT_NO_VALUE is defined, keep has no value argument. Returns the
+ * table, like delete.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_retain)(struct OAHT_PREFIX *a,
+#ifndef OAHT_NO_VALUE
+                   int (*keep)(void *arg, OAHT_KEY_T const *key,
+                               OAHT_VALUE_T *value),
+#else
+                   int (*keep)(void *arg, OAHT_KEY_T const *key),
+#endif
+                   void *arg) {
+	/* start after an EMPTY slot and end at it, once around the table */
+	OAHT_SIZE_T b = OAHT_NAME(_empty_from)(a, 0);
+	OAHT_NAME(_count_removed)(a, a, OAHT_NAME(_retain_slots)(
+		a, b + 1, b + a->mask + 1, keep, arg));
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old) {
+		b = OAHT_NAME(_empty_from)(a->old, 0);
+		OAHT_NAME(_count_removed)(a, a->old, OAHT_NAME(_retain_slots)(
+			a->old, b + 1, b + a->old->mask + 1, keep, arg));
+	}
+	#endif
+	return OAHT_NAME(_after_delete)(a);
+}
+
+#ifdef OAHT_PARALLEL_RESIZE
+/*
+ * Returns the number of positions per range to split end positions into at
+ * most *nthreads ranges, and sets *nthreads to the number of ranges. The
+ * number is a multiple of 64, so the ranges start on a word of a bit array
+ * and, if the slots are aligned, on a cache line. Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_range_step)(OAHT_SIZE_T end, unsigned *nthreads) {
+	OAHT_SIZE_T step;
+	if (*nthreads < 1)
+		*nthreads = 1;
+	step = ((end + *nthreads - 1) / *nthreads + 63) & ~(OAHT_SIZE_T)63;
+	*nthreads = (unsigned)((end + step - 1) / step);
+	return step;
+}
+
+/* A job for _for_each_task. Used internally. */
+struct OAHT_NAME(_for_each_job) {
+	struct OAHT_PREFIX *a;
+	#ifndef OAHT_NO_VALUE
+	void (*fn)(void *, OAHT_KEY_T const *, OAHT_VALUE_T *);
+	#else
+	void (*fn)(void *, OAHT_KEY_T const *);
+	#endif
+	void **args;
+	OAHT_SIZE_T end, step;
+};
+
+/* Calls _for_each_range for one range. Used internally. */
+static inline void
+OAHT_NAME(_for_each_task)(void *arg, unsigned i) {
+	struct OAHT_NAME(_for_each_job) *job =
+		(struct OAHT_NAME(_for_each_job) *)arg;
+	OAHT_SIZE_T begin = (OAHT_SIZE_T)i * job->step, end;
+	end = job->end - begin < job->step ? job->end : begin + job->step;
+	OAHT_NAME(_for_each_range)(job->a, begin, end, job->fn, job->args[i]);
+}
+
+/*
+ * Calls fn for each entry, like _for_each_range, using nthreads threads for
+ * ranges of the positions. The thread i passes args[i] to fn, e.g. a partial
+ * result to be combined when this returns. Small tables use fewer threads,
+ * leaving the last args unused.
+ */
+static inline void
+OAHT_NAME(_for_each_parallel)(struct OAHT_PREFIX *a,
+#ifndef OAHT_NO_VALUE
+                              void (*fn)(void *arg, OAHT_KEY_T const *key,
+                                         OAHT_VALUE_T *value),
+#else
+                              void (*fn)(void *arg, OAHT_KEY_T const *key),
+#endif
+                              void **args, unsigned nthreads) {
+	struct OAHT_NAME(_for_each_job) job;
+	job.a = a;
+	job.fn = fn;
+	job.args = args;
+	job.end = OAHT_NAME(_slots)(a);
+	job.step = OAHT_NAME(_range_step)(job.end, &nthreads);
+	OAHT_PARALLEL_FOR(nthreads, OAHT_NAME(_for_each_task), &job);
+}
+
+/* A job for _retain_task. Used internally. */
+struct OAHT_NAME(_retain_job) {
+	struct OAHT_PREFIX *t;
+	#ifndef OAHT_NO_VALUE
+	int (*keep)(void *, OAHT_KEY_T const *, OAHT_VALUE_T *);
+	#else
+	int (*keep)(void *, OAHT_KEY_T const *);
+	#endif
+	void **args;
+	OAHT_SIZE_T *bounds; /* EMPTY slots, range i is after bounds[i] */
+	OAHT_SIZE_T *counts; /* the number of entries each task removed */
+};
+
+/* Calls _retain_slots for one range. Used internally. */
+static inline void
+OAHT_NAME(_retain_task)(void *arg, unsigned i) {
+	struct OAHT_NAME(_retain_job) *job = (struct OAHT_NAME(_retain_job) *)arg;
+	job->counts[i] = OAHT_NAME(_retain_slots)(
+		job->t, job->bounds[i] + 1, job->bounds[i + 1], job->keep,
+		job->args[i]);
+}
+
+/*
+ * Removes the entries for which keep returns 0 from t using nthreads threads.
+ * The ranges end at EMPTY slots, which stay EMPTY, so no entry is moved from
+ * one range to another. Returns the number of entries removed. Used
+ * internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_retain_table_parallel)(struct OAHT_PREFIX *t,
+#ifndef OAHT_NO_VALUE
+                                  int (*keep)(void *, OAHT_KEY_T const *,
+                                              OAHT_VALUE_T *),
+#else
+                                  int (*keep)(void *, OAHT_KEY_T const *),
+#endif
+                                  void **args, unsigned nthreads) {
+	struct OAHT_NAME(_retain_job) job;
+	OAHT_SIZE_T step = OAHT_NAME(_range_step)(t->mask + 1, &nthreads), n = 0;
+	unsigned i;
+	job.t = t;
+	job.keep = keep;
+	job.args = args;
+	job.bounds = (OAHT_SIZE_T *)
+		OAHT_ALLOC((nthreads + 1) * sizeof(OAHT_SIZE_T));
+	job.counts = (OAHT_SIZE_T *)OAHT_ALLOC(nthreads * sizeof(OAHT_SIZE_T));
+	if (!job.bounds || !job.counts) OAHT_OOM();
+	/* a cluster across the start of a range belongs to the previous range */
+	job.bounds[0] = OAHT_NAME(_empty_from)(t, 0);
+	for (i = 1; i < nthreads; i++) {
+		OAHT_SIZE_T pos = (OAHT_SIZE_T)i * step;
+		job.bounds[i] = OAHT_NAME(_empty_from)(
+			t, pos > job.bounds[i - 1] ? pos : job.bounds[i - 1]);
+	}
+	job.bounds[nthreads] = job.bounds[0] + t->mask + 1;
+	OAHT_PARALLEL_FOR(nthreads, OAHT_NAME(_retain_task), &job);
+	for (i = 0; i < nthreads; i++)
+		n += job.counts[i];
+	OAHT_FREE(job.counts, nthreads * sizeof(OAHT_SIZE_T));
+	OAHT_FREE(job.bounds, (nthreads + 1) * sizeof(OAHT_SIZE_T));
+	return n;
 }
 
 /*
- * Allocate and copy the contents to a new memory area. Returns a pointer to
- * the new memory. Used internally.
+ * Removes the entries for which keep returns 0, like _retain, using nthreads
+ * threads for ranges of the slots. The thread i passes args[i] to keep. While
+ * snapshots of the table exist, this is done by the calling thread.
  */
 static inline struct OAHT_PREFIX *
-OAHT_NAME(_resize)(struct OAHT_PREFIX *a, OAHT_SIZE_T min_size) {
-	struct OAHT_PREFIX *b = OAHT_NAME(_create_presized)(min_size);
+OAHT_NAME(_retain_parallel)(struct OAHT_PREFIX *a,
+#ifndef OAHT_NO_VALUE
+                            int (*keep)(void *arg, OAHT_KEY_T const *key,
+                                        OAHT_VALUE_T *value),
+#else
+                            int (*keep)(void *arg, OAHT_KEY_T const *key),
+#endif
+                            void **args, unsigned nthreads) {
+	#ifdef OAHT_SNAPSHOT
+	/* copying the pages for the snapshots isn't thread-safe */
+	if (a->snapshots)
+		nthreads = 1;
+	#endif
+	OAHT_NAME(_count_removed)(a, a, OAHT_NAME(_retain_table_parallel)(
+		a, keep, args, nthreads));
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	if (a->old)
+		OAHT_NAME(_count_removed)(a, a->old,
+			OAHT_NAME(_retain_table_parallel)(a->old, keep, args,
+			                                  nthreads));
+	#endif
+	return OAHT_NAME(_after_delete)(a);
+}
+#endif
+
+#ifdef OAHT_NO_VALUE
+/*
+ * Set operations. The result is a new set and the operands are unchanged. The
+ * entries of one set are looked up in the other and copied to the result with
+ * their stored hashes, so the keys are only hashed again if the sets have
+ * different seeds, if a set is small or with OAHT_NO_STORE_HASH.
+ */
+
+/*
+ * The hash of an entry of the table a, as returned by _hash for the table b.
+ * Used internally.
+ */
+static inline OAHT_HASH_T
+OAHT_NAME(_hash_for)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                     struct OAHT_PREFIX *b) {
+	#ifdef OAHT_HASH_FN
+	if (a->seed != b->seed)
+		return OAHT_NAME(_hash)(b, e->key);
+	#endif
+	#ifdef OAHT_SMALL_SIZE
+	/* the stored hashes are 0 in a small table */
+	if (OAHT_NAME(_is_small)(a->mask))
+		return OAHT_NAME(_hash)(b, e->key);
+	#endif
+	(void)b;
+	return OAHT_NAME(_get_hash_of_entry)(a, e);
+}
+
+/*
+ * Checks if an entry of the table a is in the table b, without modifying b.
+ * Used internally.
+ */
+static inline int
+OAHT_NAME(_entry_in)(struct OAHT_PREFIX *a, struct OAHT_NAME(_entry) *e,
+                     struct OAHT_PREFIX *b) {
+	OAHT_HASH_T hash = OAHT_NAME(_hash_for)(a, e, b);
+	return OAHT_NAME(_find)(b, e->key, OAHT_NAME(_hash_given)(b, hash),
+	                        NULL) != NULL;
+}
+
+/*
+ * Inserts an entry of the table a, if it's not there, into the table r, which
+ * must have room for it. Used internally.
+ */
+static inline void
+OAHT_NAME(_put_entry)(struct OAHT_PREFIX *r, struct OAHT_PREFIX *a,
+                      struct OAHT_NAME(_entry) *e) {
+	OAHT_HASH_T hash = OAHT_NAME(_hash_for)(a, e, r);
+	OAHT_NAME(_put)(r, e->key, OAHT_NAME(_hash_given)(r, hash), NULL, NULL);
+}
+
+/*
+ * An empty set with room for n keys and the seed of a, so that the hashes of
+ * a are valid for it. Used internally.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_create_like)(struct OAHT_PREFIX *a, OAHT_SIZE_T n) {
+	struct OAHT_PREFIX *r =
+		OAHT_NAME(_create_presized)(OAHT_NAME(_min_size)(n));
+	#ifdef OAHT_HASH_FN
+	r->seed = a->seed;
+	#else
+	(void)a;
+	#endif
+	return r;
+}
+
+/*
+ * Returns a new set of the keys which are in a or in b. The larger set is
+ * cloned, grown once to make room for the keys of the smaller one, which are
+ * then added.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_union)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b) {
+	struct OAHT_PREFIX *l = a->used >= b->used ? a : b, *s = l == a ? b : a;
+	struct OAHT_PREFIX *r = OAHT_NAME(_clone)(l);
+	struct OAHT_NAME(_entry) *e;
+	OAHT_SIZE_T pos = 0;
+	r = OAHT_NAME(_make_space)(r, s->used);
+	while ((e = OAHT_NAME(_next)(s, &pos)))
+		OAHT_NAME(_put_entry)(r, s, e);
+	return r;
+}
+
+/*
+ * Returns a new set of the keys which are in both a and b. The keys of the
+ * smaller set are looked up in the larger one.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_intersect)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b) {
+	struct OAHT_PREFIX *l = a->used >= b->used ? a : b, *s = l == a ? b : a;
+	struct OAHT_PREFIX *r = OAHT_NAME(_create_like)(s, s->used);
+	struct OAHT_NAME(_entry) *e;
+	OAHT_SIZE_T pos = 0;
+	while ((e = OAHT_NAME(_next)(s, &pos)))
+		if (OAHT_NAME(_entry_in)(s, e, l))
+			OAHT_NAME(_put_entry)(r, s, e);
+	return OAHT_NAME(_compact)(r);
+}
+
+/*
+ * Returns a new set of the keys which are in a but not in b. If b is much
+ * smaller, a is cloned and the keys of b are deleted from the clone, which
+ * isn't resized until it's compacted at the end. Otherwise the keys of a are
+ * looked up in b.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_difference)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b) {
+	struct OAHT_PREFIX *r;
+	struct OAHT_NAME(_entry) *e, *d;
+	OAHT_SIZE_T pos = 0;
+	OAHT_HASH_T hash;
+	if (b->used < a->used / 4) {
+		r = OAHT_NAME(_clone)(a);
+		while ((e = OAHT_NAME(_next)(b, &pos))) {
+			hash = OAHT_NAME(_hash_given)(r,
+				OAHT_NAME(_hash_for)(b, e, r));
+			d = OAHT_NAME(_lookup_helper)(r, e->key, hash);
+			if (!OAHT_NAME(_is_miss)(r, d, hash)) {
+				OAHT_NAME(_remove_entry)(r, d);
+				r->used--;
+			}
+			#ifdef OAHT_INCREMENTAL_RESIZE
+			else if (r->old)
+				OAHT_NAME(_delete_from_old)(r, e->key, hash);
+			#endif
+		}
+		return OAHT_NAME(_compact)(r);
+	}
+	r = OAHT_NAME(_create_like)(a, a->used);
+	while ((e = OAHT_NAME(_next)(a, &pos)))
+		if (!OAHT_NAME(_entry_in)(a, e, b))
+			OAHT_NAME(_put_entry)(r, a, e);
+	return OAHT_NAME(_compact)(r);
+}
+
+#ifdef OAHT_PARALLEL_RESIZE
+/*
+ * The parallel set operations do the lookups using nthreads threads, each
+ * looking up the entries in a range of the slots, and mark the entries which
+ * belong to the result. The result is then sized for the marked entries and
+ * they're inserted by the calling thread.
+ */
+
+/* A job for _mark_task. Used internally. */
+struct OAHT_NAME(_mark_job) {
+	struct OAHT_PREFIX *a, *b;
+	int in; /* mark the entries of a which are in b, or which aren't */
+	unsigned long long *marks; /* a bit per position of _next in a */
+	OAHT_SIZE_T end, step; /* step positions per task, a multiple of 64 */
+	OAHT_SIZE_T *counts; /* the number of entries each task marked */
+};
+
+/* Marks the entries of one range of the slots. Used internally. */
+static inline void
+OAHT_NAME(_mark_task)(void *arg, unsigned i) {
+	struct OAHT_NAME(_mark_job) *job = (struct OAHT_NAME(_mark_job) *)arg;
+	OAHT_SIZE_T pos = (OAHT_SIZE_T)i * job->step, end, n = 0;
+	struct OAHT_NAME(_entry) *e;
+	end = job->end - pos < job->step ? job->end : pos + job->step;
+	/* the returned pos is past the entry */
+	while (pos < end && (e = OAHT_NAME(_next)(job->a, &pos)) && pos <= end) {
+		if (OAHT_NAME(_entry_in)(job->a, e, job->b) == job->in) {
+			job->marks[(pos - 1) / 64] |= 1ULL << ((pos - 1) % 64);
+			n++;
+		}
+	}
+	job->counts[i] = n;
+}
+
+/*
+ * Marks the entries of a which are in b, if in is 1, or which aren't, using
+ * nthreads threads. Returns the bit array of the marked positions, to be
+ * free'd using _marks_free, and sets *n to the number of marked entries.
+ * Used internally.
+ */
+static inline unsigned long long *
+OAHT_NAME(_mark_parallel)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b, int in,
+                          unsigned nthreads, OAHT_SIZE_T *n) {
+	struct OAHT_NAME(_mark_job) job;
+	size_t words;
+	unsigned i;
+	job.a = a;
+	job.b = b;
+	job.in = in;
+	job.end = OAHT_NAME(_slots)(a);
+	job.step = OAHT_NAME(_range_step)(job.end, &nthreads);
+	words = (size_t)job.end / 64 + 1;
+	job.marks = (unsigned long long *)OAHT_ALLOC(words * sizeof(unsigned long long));
+	job.counts = (OAHT_SIZE_T *)OAHT_ALLOC(nthreads * sizeof(OAHT_SIZE_T));
+	if (!job.marks || !job.counts) OAHT_OOM();
+	memset(job.marks, 0, words * sizeof(unsigned long long));
+	OAHT_PARALLEL_FOR(nthreads, OAHT_NAME(_mark_task), &job);
+	for (*n = 0, i = 0; i < nthreads; i++)
+		*n += job.counts[i];
+	OAHT_FREE(job.counts, nthreads * sizeof(OAHT_SIZE_T));
+	return job.marks;
+}
+
+/* Frees the bit array returned by _mark_parallel for a. Used internally. */
+static inline void
+OAHT_NAME(_marks_free)(struct OAHT_PREFIX *a, unsigned long long *marks) {
+	(void)a; /* unused if OAHT_FREE ignores the size */
+	OAHT_FREE(marks, ((size_t)OAHT_NAME(_slots)(a) / 64 + 1) *
+	                 sizeof(unsigned long long));
+}
+
+/* Inserts the marked entries of a into r. Used internally. */
+static inline void
+OAHT_NAME(_put_marked)(struct OAHT_PREFIX *r, struct OAHT_PREFIX *a,
+                       unsigned long long *marks) {
+	struct OAHT_NAME(_entry) *e;
+	OAHT_SIZE_T pos = 0;
+	while ((e = OAHT_NAME(_next)(a, &pos)))
+		if (marks[(pos - 1) / 64] >> ((pos - 1) % 64) & 1)
+			OAHT_NAME(_put_entry)(r, a, e);
+}
+
+/*
+ * Like _union, looking up the keys of the smaller set in the larger one using
+ * nthreads threads, so that the result is only grown for the missing ones.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_union_parallel)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b,
+                           unsigned nthreads) {
+	struct OAHT_PREFIX *l = a->used >= b->used ? a : b, *s = l == a ? b : a;
+	struct OAHT_PREFIX *r;
+	OAHT_SIZE_T n;
+	unsigned long long *marks =
+		OAHT_NAME(_mark_parallel)(s, l, 0, nthreads, &n);
+	r = OAHT_NAME(_make_space)(OAHT_NAME(_clone)(l), n);
+	OAHT_NAME(_put_marked)(r, s, marks);
+	OAHT_NAME(_marks_free)(s, marks);
+	return r;
+}
+
+/* Like _intersect, doing the lookups using nthreads threads. */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_intersect_parallel)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b,
+                               unsigned nthreads) {
+	struct OAHT_PREFIX *l = a->used >= b->used ? a : b, *s = l == a ? b : a;
+	struct OAHT_PREFIX *r;
+	OAHT_SIZE_T n;
+	unsigned long long *marks =
+		OAHT_NAME(_mark_parallel)(s, l, 1, nthreads, &n);
+	r = OAHT_NAME(_create_like)(s, n);
+	OAHT_NAME(_put_marked)(r, s, marks);
+	OAHT_NAME(_marks_free)(s, marks);
+	return r;
+}
+
+/* Like _difference, looking up the keys of a in b using nthreads threads. */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_difference_parallel)(struct OAHT_PREFIX *a, struct OAHT_PREFIX *b,
+                                unsigned nthreads) {
+	struct OAHT_PREFIX *r;
+	OAHT_SIZE_T n;
+	unsigned long long *marks =
+		OAHT_NAME(_mark_parallel)(a, b, 0, nthreads, &n);
+	r = OAHT_NAME(_create_like)(a, n);
+	OAHT_NAME(_put_marked)(r, a, marks);
+	OAHT_NAME(_marks_free)(a, marks);
+	return r;
+}
+#endif
+#endif
+
+#ifdef OAHT_SNAPSHOT
+/*
+ * Snapshots of a table. _snapshot and _snapshot_release must be called by the
+ * writer, i.e. not at the same time as a function modifying the table. The
+ * other snapshot functions may be called by any thread at any time until the
+ * snapshot is released, also while the writer modifies or resizes the table.
+ * A snapshot doesn't see values modified through the pointers returned by
+ * _next, _entry_value or _scan, but get_ptr and upsert are safe to use.
+ */
+
+/* Size to allocate for a snapshot of a table with mask mask. Used internally. */
+static inline size_t
+OAHT_NAME(_snapshot_sizeof)(OAHT_SIZE_T mask) {
+	return sizeof(struct OAHT_NAME(_snapshot)) +
+		mask / OAHT_SNAPSHOT_PAGE * sizeof(struct OAHT_NAME(_page) *);
+}
+
+/*
+ * Takes a snapshot of the table, which needs to be released using
+ * _snapshot_release. No entries are copied until the table is modified.
+ */
+static inline struct OAHT_NAME(_snapshot) *
+OAHT_NAME(_snapshot)(struct OAHT_PREFIX *a) {
+	size_t size = OAHT_NAME(_snapshot_sizeof)(a->mask);
+	struct OAHT_NAME(_snapshot) *s =
+		(struct OAHT_NAME(_snapshot) *)OAHT_ALLOC(size);
+	if (!s) OAHT_OOM();
+	memset(s, 0, size);
+	s->table = a;
+	s->used = a->used;
+	s->mask = a->mask;
+	s->next = a->snapshots;
+	a->snapshots = s;
+	return s;
+}
+
+/*
+ * Frees a snapshot, the copies of the pages which no other snapshot shares
+ * and the table it was taken of, if the table has been replaced by a resize
+ * or destroyed and no other snapshot reads it.
+ */
+static inline void
+OAHT_NAME(_snapshot_release)(struct OAHT_NAME(_snapshot) *s) {
+	struct OAHT_PREFIX *a = s->table;
+	struct OAHT_NAME(_snapshot) **p;
 	OAHT_SIZE_T i;
-	/* copy user-defined header data */
-	#ifdef OAHT_HEADER
-	memcpy(b, a, offsetof(struct OAHT_PREFIX, fill));
+	for (i = 0; i <= s->mask / OAHT_SNAPSHOT_PAGE; i++) {
+		struct OAHT_NAME(_page) *copy = s->pages[i];
+		if (copy && --copy->refs == 0)
+			OAHT_FREE(copy, sizeof(struct OAHT_NAME(_page)));
+	}
+	for (p = &a->snapshots; *p != s; p = &(*p)->next);
+	*p = s->next;
+	if (a->replaced && !a->snapshots)
+		OAHT_FREE(a, OAHT_NAME(_sizeof)(a->mask));
+	OAHT_FREE(s, OAHT_NAME(_snapshot_sizeof)(s->mask));
+}
+
+/* Returns the number of entries in the snapshot. */
+static inline OAHT_SIZE_T
+OAHT_NAME(_snapshot_len)(struct OAHT_NAME(_snapshot) *s) {
+	return s->used;
+}
+
+/*
+ * Reads the slot pos of the snapshot to e and, with OAHT_SOA, its value to
+ * value. The slot is read from the copy of its page or, if there is none,
+ * from the table and then checked like a seqlock: if a copy has been made
+ * meanwhile, the writer may have modified the slot, so it's read from the
+ * copy instead. Used internally.
+ */
+static inline void
+OAHT_NAME(_snapshot_slot)(struct OAHT_NAME(_snapshot) *s, OAHT_SIZE_T pos,
+                          struct OAHT_NAME(_entry) *e, OAHT_VALUE_T *value) {
+	struct OAHT_NAME(_page) *copy =
+		__atomic_load_n(&s->pages[pos / OAHT_SNAPSHOT_PAGE], __ATOMIC_ACQUIRE);
+	if (!copy) {
+		memcpy(e, &s->table->els[pos], sizeof(struct OAHT_NAME(_entry)));
+		#ifdef OAHT_SOA_VALUES
+		*value = OAHT_NAME(_values)(s->table)[pos];
+		#endif
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		copy = __atomic_load_n(&s->pages[pos / OAHT_SNAPSHOT_PAGE],
+		                       __ATOMIC_ACQUIRE);
+		if (!copy)
+			return;
+	}
+	memcpy(e, &copy->els[pos % OAHT_SNAPSHOT_PAGE],
+	       sizeof(struct OAHT_NAME(_entry)));
+	#ifdef OAHT_SOA_VALUES
+	*value = copy->values[pos % OAHT_SNAPSHOT_PAGE];
+	#else
+	(void)value;
 	#endif
-	/* set the used and fill values as they will be */
-	b->used = b->fill = a->used;
-	/* copy the entries */
-	for (i = 0; i <= a->mask; i++) {
-		struct OAHT_NAME(_entry) *ea = &a->els[i];
-		struct OAHT_NAME(_entry) *eb;
-		if (OAHT_IS_EMPTY_KEY(ea->key)
-		    || OAHT_IS_DELETED_KEY(ea->key))
+}
+
+/*
+ * Iterates over the keys and values of the snapshot, like _iter does over a
+ * table.
+ */
+static inline OAHT_SIZE_T
+OAHT_NAME(_snapshot_iter)(struct OAHT_NAME(_snapshot) *s, OAHT_SIZE_T pos,
+                          OAHT_KEY_T *k, OAHT_VALUE_T *v) {
+	struct OAHT_NAME(_entry) e;
+	OAHT_VALUE_T value;
+	for (; pos <= s->mask; pos++) {
+		OAHT_NAME(_snapshot_slot)(s, pos, &e, &value);
+		if (OAHT_IS_EMPTY_KEY(e.key) || OAHT_IS_DELETED_SLOT(e.key))
 			continue;
-		eb = OAHT_NAME(_lookup_helper)(b, ea->key, OAHT_NAME(_get_hash_of_entry)(ea));
-		assert(OAHT_IS_EMPTY_KEY(eb->key));
-		memcpy(eb, ea, sizeof(struct OAHT_NAME(_entry)));
+		*k = e.key;
+		#ifndef OAHT_NO_VALUE
+		if (v) {
+			#ifdef OAHT_SOA_VALUES
+			*v = value;
+			#else
+			*v = e.value;
+			#endif
+		}
+		#else
+		(void)v;
+		#endif
+		return pos + 1;
 	}
-	/* Free the memory of the old table */
-	OAHT_FREE(a, OAHT_SIZEOF(a->mask));
-	return b;
+	return 0;
 }
 
 /*
- * Check if a key exists. Returns 1 if it does, 0 if it doesn't.
+ * Finds a key in the snapshot. Returns 1 and sets e and, with OAHT_SOA,
+ * value if it's found, otherwise returns 0. Used internally.
  */
 static inline int
-OAHT_NAME(_contains)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
-	struct OAHT_NAME(_entry) *e = OAHT_NAME(_lookup_helper)(a, key, OAHT_HASH(key));
-	return !OAHT_IS_EMPTY_KEY(e->key) && !OAHT_IS_DELETED_KEY(e->key);
+OAHT_NAME(_snapshot_find)(struct OAHT_NAME(_snapshot) *s, OAHT_KEY_T key,
+                          struct OAHT_NAME(_entry) *e, OAHT_VALUE_T *value) {
+	OAHT_HASH_T hash = OAHT_NAME(_hash_of)(s->table, key);
+	OAHT_SIZE_T pos = hash & s->mask, n;
+	for (n = 0; n <= s->mask; n++) {
+		OAHT_NAME(_snapshot_slot)(s, pos, e, value);
+		if (OAHT_IS_EMPTY_KEY(e->key))
+			return 0;
+		if (OAHT_NAME(_entry_matches)(e, key, hash))
+			return 1;
+		pos = (pos + 1) & s->mask;
+	}
+	return 0;
 }
 
-#ifndef OAHT_NO_VALUE
-/* The hashtable has values. Provide get and set functions. */
+/* Checks if a key is in the snapshot. */
+static inline int
+OAHT_NAME(_snapshot_contains)(struct OAHT_NAME(_snapshot) *s, OAHT_KEY_T key) {
+	struct OAHT_NAME(_entry) e;
+	OAHT_VALUE_T value;
+	return OAHT_NAME(_snapshot_find)(s, key, &e, &value);
+}
 
+#ifndef OAHT_NO_VALUE
 /*
- * Fetch a value by its key. If it's not defined, default_value is returned.
+ * Fetches the value of a key in the snapshot, or default_value if the key is
+ * not in it.
  */
 static inline OAHT_VALUE_T
-OAHT_NAME(_get)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_VALUE_T default_value) {
-	struct OAHT_NAME(_entry) *entry =
-		OAHT_NAME(_lookup_helper)(a, key, OAHT_HASH(key));
-	return OAHT_IS_EMPTY_KEY(entry->key) || OAHT_IS_DELETED_KEY(entry->key)
-		? default_value : entry->value;
+OAHT_NAME(_snapshot_get)(struct OAHT_NAME(_snapshot) *s, OAHT_KEY_T key,
+                         OAHT_VALUE_T default_value) {
+	struct OAHT_NAME(_entry) e;
+	OAHT_VALUE_T value;
+	if (!OAHT_NAME(_snapshot_find)(s, key, &e, &value))
+		return default_value;
+	#ifdef OAHT_SOA_VALUES
+	return value;
+	#else
+	return e.value;
+	#endif
 }
+#endif
+#endif
 
+#ifdef OAHT_MMAP
 /*
- * Insert or replace the element at the given key. Returns a pointer to the same
- * memory location or to a new memory location if the memory has been
- * reallocated. (If the hash tables has been reallocated, the old memory has
- * been free'd.)
+ * The header of a file written by _save. The table follows at offset
+ * OAHT_FILE_OFFSET, so that it's aligned like allocated memory. Used
+ * internally.
  */
-static inline struct OAHT_PREFIX *
-OAHT_NAME(_set)(struct OAHT_PREFIX *a, OAHT_KEY_T key, OAHT_VALUE_T value) {
-	OAHT_HASH_T hash = OAHT_HASH(key);
-	struct OAHT_NAME(_entry) *entry =
-		OAHT_NAME(_lookup_helper)(a, key, hash);
-	if (OAHT_IS_EMPTY_KEY(entry->key)) {
-		a->used++;
-		a->fill++;
-	} else if (OAHT_IS_DELETED_KEY(entry->key))
-		a->used++;
+#define OAHT_FILE_MAGIC "oahtfile"
+#define OAHT_FILE_VERSION 1
+#define OAHT_FILE_OFFSET 64
+struct OAHT_NAME(_file_header) {
+	char magic[8];
+	unsigned int byte_order;         /* 0x01020304 in the writer's order */
+	unsigned int version;
+	unsigned int options;            /* the options affecting the layout */
+	unsigned int hash_id;            /* OAHT_HASH_ID */
+	unsigned int sizes[5];           /* key, value, size, hash, entry */
+	unsigned int table_size;         /* sizeof(struct OAHT_PREFIX) */
+	unsigned long long mask;
+};
+
+/* The header of the file for the table. Used internally. */
+static inline void
+OAHT_NAME(_file_header_of)(struct OAHT_NAME(_file_header) *h, OAHT_SIZE_T mask) {
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, OAHT_FILE_MAGIC, 8);
+	h->byte_order = 0x01020304;
+	h->version = OAHT_FILE_VERSION;
 	#ifndef OAHT_NO_STORE_HASH
-	entry->hash  = hash;
+	h->options |= 1;
 	#endif
-	entry->key   = key;
-	entry->value = value;
-	/* resize if 2/3 full */
-	if (a->fill * 3 >= (a->mask + 1) * 2)
-		return OAHT_NAME(_resize)(a, (a->used > 50000 ? 2 : 4) * a->used);
-	return a;
+	#ifdef OAHT_NO_VALUE
+	h->options |= 2;
+	#endif
+	#ifdef OAHT_SOA_VALUES
+	h->options |= 4;
+	#endif
+	#ifdef OAHT_BACKSHIFT_DELETE
+	h->options |= 8;
+	#endif
+	#ifdef OAHT_ROBIN_HOOD
+	h->options |= 16;
+	#endif
+	#ifdef OAHT_CONTROL_BYTES
+	h->options |= 32 | OAHT_GROUP_WIDTH << 8;
+	#endif
+	#ifdef OAHT_SMALL_SIZE
+	h->options |= (unsigned)OAHT_SMALL_SIZE << 16;
+	#endif
+	h->hash_id = OAHT_HASH_ID;
+	h->sizes[0] = sizeof(OAHT_KEY_T);
+	#ifndef OAHT_NO_VALUE
+	h->sizes[1] = sizeof(OAHT_VALUE_T);
+	#endif
+	h->sizes[2] = sizeof(OAHT_SIZE_T);
+	h->sizes[3] = sizeof(OAHT_HASH_T);
+	h->sizes[4] = sizeof(struct OAHT_NAME(_entry));
+	h->table_size = sizeof(struct OAHT_PREFIX);
+	h->mask = mask;
 }
 
-#else
-/* The hash table is a set. Provide an add function instead of get and set. */
+/* Writes n bytes, continuing after partial writes. Used internally. */
+static inline int
+OAHT_NAME(_write_all)(int fd, const void *buf, size_t n) {
+	const char *p = (const char *)buf;
+	while (n > 0) {
+		ssize_t w = write(fd, p, n < ((size_t)1 << 30) ? n : (size_t)1 << 30);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0)
+			return -1;
+		p += w;
+		n -= (size_t)w;
+	}
+	return 0;
+}
 
 /*
- * Add an element (key) to the set. Returns a pointer to the same
- * memory location or to a new memory location if the memory has been
- * reallocated. (If the hash tables has been reallocated, the old memory has
- * been free'd.)
- *
- * (This is identical to the set function except there is no value.)
+ * Writes the table to a file, which can then be mapped using _open_mmap. The
+ * table is written as it is in memory, so the keys and values must not be or
+ * contain pointers. Returns 0 on success, or -1 with errno set if writing
+ * fails.
  */
-static inline struct OAHT_PREFIX *
-OAHT_NAME(_add)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
-	OAHT_HASH_T hash = OAHT_HASH(key);
-	struct OAHT_NAME(_entry) *entry =
-		OAHT_NAME(_lookup_helper)(a, key, hash);
-	if (OAHT_IS_EMPTY_KEY(entry->key)) {
-		a->used++;
-		a->fill++;
-	} else if (OAHT_IS_DELETED_KEY(entry->key))
-		a->used++;
-	#ifndef OAHT_NO_STORE_HASH
-	entry->hash  = hash;
+static inline int
+OAHT_NAME(_save)(struct OAHT_PREFIX *a, int fd) {
+	struct OAHT_NAME(_file_header) h;
+	struct OAHT_PREFIX t;
+	char pad[OAHT_FILE_OFFSET];
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	/* only one table is written */
+	OAHT_NAME(_finish_migration)(a);
 	#endif
-	entry->key   = key;
-	/* resize if 2/3 full */
-	if (a->fill * 3 >= (a->mask + 1) * 2)
-		return OAHT_NAME(_resize)(a, (a->used > 50000 ? 2 : 4) * a->used);
+	OAHT_NAME(_file_header_of)(&h, a->mask);
+	memset(pad, 0, sizeof(pad));
+	memcpy(pad, &h, sizeof(h));
+	/* the pointers in the header are meaningless in the file */
+	memcpy(&t, a, sizeof(t));
+	#ifdef OAHT_INCREMENTAL_RESIZE
+	t.old = NULL;
+	#endif
+	#ifdef OAHT_CONCURRENT_READ
+	t.retired = NULL;
+	#endif
+	#ifdef OAHT_SNAPSHOT
+	t.snapshots = NULL;
+	#endif
+	if (OAHT_NAME(_write_all)(fd, pad, sizeof(pad)) ||
+	    OAHT_NAME(_write_all)(fd, &t, sizeof(t)) ||
+	    OAHT_NAME(_write_all)(fd, (char *)a + sizeof(t),
+	                          OAHT_NAME(_sizeof)(a->mask) - sizeof(t)))
+		return -1;
+	return 0;
+}
+
+/*
+ * Maps a file written by _save read-only. The pages are loaded when they're
+ * used and shared by all processes mapping the same file. Only get, get_many,
+ * contains, contains_many, len and iter may be used on the table, and it must
+ * be unmapped using _close_mmap. Returns NULL with errno set if the file
+ * can't be mapped, or with errno set to EINVAL if it was written with a
+ * different configuration, hash function or byte order.
+ */
+static inline struct OAHT_PREFIX *
+OAHT_NAME(_open_mmap)(const char *path) {
+	struct OAHT_NAME(_file_header) h, expected;
+	struct OAHT_PREFIX *a;
+	struct stat st;
+	void *p;
+	int fd = open(path, O_RDONLY), err;
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	if ((size_t)st.st_size < OAHT_FILE_OFFSET + sizeof(struct OAHT_PREFIX)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);
+	if (p == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+	a = (struct OAHT_PREFIX *)((char *)p + OAHT_FILE_OFFSET);
+	memcpy(&h, p, sizeof(h));
+	OAHT_NAME(_file_header_of)(&expected, (OAHT_SIZE_T)h.mask);
+	if (memcmp(&h, &expected, sizeof(h)) != 0 || a->mask != h.mask ||
+	    (size_t)st.st_size != OAHT_FILE_OFFSET + OAHT_NAME(_sizeof)(a->mask)) {
+		munmap(p, (size_t)st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
 	return a;
 }
 
+/* Unmaps a table mapped by _open_mmap. */
+static inline void
+OAHT_NAME(_close_mmap)(struct OAHT_PREFIX *a) {
+	munmap((char *)a - OAHT_FILE_OFFSET,
+	       OAHT_FILE_OFFSET + OAHT_NAME(_sizeof)(a->mask));
+}
 #endif
 
+#ifdef OAHT_CONCURRENT_READ
 /*
- * Delete the given key from the hashtable. Returns a pointer to the same
- * memory location or to a new memory location if the memory has been
- * reallocated. (If the hash tables has been reallocated, the old memory has
- * been free'd.)
+ * Publication of a table to concurrent readers. The writer keeps using the
+ * functions above and publishes the table after modifying it. Readers get the
+ * published table using _read_lock and may then use get, get_many, contains
+ * and contains_many on it until _read_unlock. A table replaced by a resize is
+ * free'd when no reader can be using it anymore, which is tracked by epochs:
+ * each reader announces the epoch in which it got the table.
+ *
+ * Each reader thread has its own number, 0 to OAHT_MAX_READERS - 1.
+ */
+struct OAHT_NAME(_rcu) {
+	struct OAHT_PREFIX *table;       /* the published table */
+	unsigned long epoch;             /* incremented when tables are retired */
+	struct OAHT_PREFIX *retired;     /* tables to free, the newest first */
+	char pad[OAHT_CACHE_LINE];
+	struct {
+		unsigned long epoch;         /* 0 when not reading */
+		char pad[OAHT_CACHE_LINE - sizeof(unsigned long)];
+	} readers[OAHT_MAX_READERS];
+};
+
+/* Initializes r with the table a published. */
+static inline void
+OAHT_NAME(_rcu_init)(struct OAHT_NAME(_rcu) *r, struct OAHT_PREFIX *a) {
+	memset(r, 0, sizeof(*r));
+	r->table = a;
+	r->epoch = 1;
+}
+
+/*
+ * Returns the published table, which can be read until _read_unlock is called
+ * by the same reader.
  */
 static inline struct OAHT_PREFIX *
-OAHT_NAME(_delete)(struct OAHT_PREFIX *a, OAHT_KEY_T key) {
-	struct OAHT_NAME(_entry) *entry =
-		OAHT_NAME(_lookup_helper)(a, key, OAHT_HASH(key));
-	if (!OAHT_IS_EMPTY_KEY(entry->key) && !OAHT_IS_DELETED_KEY(entry->key)) {
-		entry->key = OAHT_DELETED_KEY;
-		a->used--;
-		/* Maybe TODO: resize */
+OAHT_NAME(_read_lock)(struct OAHT_NAME(_rcu) *r, int reader) {
+	unsigned long epoch = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&r->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(&r->table, __ATOMIC_SEQ_CST);
+}
+
+/* Ends the reading of the table returned by _read_lock. */
+static inline void
+OAHT_NAME(_read_unlock)(struct OAHT_NAME(_rcu) *r, int reader) {
+	__atomic_store_n(&r->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Frees the retired tables which no reader can be using anymore. This is done
+ * by _publish, but the writer may call it explicitly to free the memory
+ * sooner after the readers are done.
+ */
+static inline void
+OAHT_NAME(_reclaim)(struct OAHT_NAME(_rcu) *r) {
+	unsigned long min = (unsigned long)-1;
+	struct OAHT_PREFIX **p = &r->retired;
+	int i;
+	for (i = 0; i < OAHT_MAX_READERS; i++) {
+		unsigned long e =
+			__atomic_load_n(&r->readers[i].epoch, __ATOMIC_SEQ_CST);
+		if (e && e < min)
+			min = e;
 	}
-	return a;
+	/* a reader in epoch e may be using the tables retired in epoch e or later */
+	while (*p && (*p)->retired_epoch >= min)
+		p = &(*p)->retired;
+	if (*p) {
+		OAHT_NAME(_destroy)(*p);
+		*p = NULL;
+	}
+}
+
+/*
+ * Publishes the table a, as returned by the last modification, to the
+ * readers. The tables it has replaced are retired and free'd later. Must only
+ * be called by the writer.
+ */
+static inline void
+OAHT_NAME(_publish)(struct OAHT_NAME(_rcu) *r, struct OAHT_PREFIX *a) {
+	assert(a == r->table || a->retired);
+	if (a->retired) {
+		struct OAHT_PREFIX *last = a->retired;
+		__atomic_store_n(&r->table, a, __ATOMIC_SEQ_CST);
+		for (;; last = last->retired) {
+			last->retired_epoch = r->epoch;
+			if (!last->retired)
+				break;
+		}
+		last->retired = r->retired;
+		r->retired = a->retired;
+		a->retired = NULL;
+		__atomic_store_n(&r->epoch, r->epoch + 1, __ATOMIC_SEQ_CST);
+	}
+	OAHT_NAME(_reclaim)(r);
+}
+
+/*
+ * Frees the published table and the retired ones. There must be no readers.
+ */
+static inline void
+OAHT_NAME(_rcu_destroy)(struct OAHT_NAME(_rcu) *r) {
+	if (r->retired)
+		OAHT_NAME(_destroy)(r->retired);
+	OAHT_NAME(_destroy)(r->table);
+	r->retired = r->table = NULL;
 }
+#endif
 
 #define OAHT_H
 #endif
@@ -0,0 +1,444 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Viktor Söderqvist
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * oaht_cuckoo.h - A set using bucketized cuckoo hashing
+ *
+ * The slots are grouped in buckets of OAHT_CUCKOO_SLOTS keys, aligned to cache
+ * lines. Each key has two buckets, chosen by its hash, and is in one of them,
+ * so a lookup reads two buckets and nothing else. An insert into two full
+ * buckets moves a key of one of them to its other bucket, which may move
+ * another key, and so on. This allows a load of 95% instead of the 2/3 of
+ * linear probing, at the cost of slower inserts. Only keys are stored.
+ *
+ * The keys are configured by the same macros as the oaht.h tables, which is
+ * included from here unless it has already been included.
+ */
+
+#ifndef OAHT_CUCKOO_H
+
+#ifndef OAHT_H
+	#include "oaht.h"
+#endif
+
+/* For a seeded hash function, if oaht.h was included without one */
+#ifdef OAHT_HASH_FN
+	#include "oaht_hash.h"
+	#ifndef OAHT_SEED
+		#define OAHT_SEED(a) oaht_hash_seed(a)
+	#endif
+#endif
+
+/* Generics: prefix to use for the cuckoo set. Defaults to oaht_cuckoo. */
+#ifndef OAHT_CUCKOO_PREFIX
+	#define OAHT_CUCKOO_PREFIX oaht_cuckoo
+#endif
+
+#undef OAHT_CNAME
+#define OAHT_CNAME(name) OAHT_XNAME(OAHT_CUCKOO_PREFIX, name)
+
+/* The keys per bucket, a power of 2. Defaults to 4. */
+#ifndef OAHT_CUCKOO_SLOTS
+	#define OAHT_CUCKOO_SLOTS 4
+#endif
+
+/*
+ * The set grows when more than OAHT_CUCKOO_MAX_LOAD_NUM /
+ * OAHT_CUCKOO_MAX_LOAD_DEN of the slots would be used. Defaults to 95%.
+ */
+#ifndef OAHT_CUCKOO_MAX_LOAD_NUM
+	#define OAHT_CUCKOO_MAX_LOAD_NUM 95
+	#define OAHT_CUCKOO_MAX_LOAD_DEN 100
+#endif
+
+/*
+ * The number of keys an insert moves before it gives up and the set grows,
+ * even if it's below the maximum load. Defaults to 500.
+ */
+#ifndef OAHT_CUCKOO_MAX_KICKS
+	#define OAHT_CUCKOO_MAX_KICKS 500
+#endif
+
+#ifndef OAHT_CACHE_LINE
+	#define OAHT_CACHE_LINE 64
+#endif
+
+/* A bucket of keys. Used internally. */
+struct OAHT_CNAME(_bucket) {
+	OAHT_KEY_T keys[OAHT_CUCKOO_SLOTS];
+};
+
+/* The cuckoo set type. The buckets follow, aligned to OAHT_CACHE_LINE. */
+struct OAHT_CUCKOO_PREFIX {
+	OAHT_SIZE_T used;
+	OAHT_SIZE_T mask; /* the number of buckets - 1 */
+	unsigned rng; /* for choosing the keys to move */
+	#ifdef OAHT_HASH_FN
+	unsigned long long seed;
+	#endif
+};
+
+/* The buckets of a set. Used internally. */
+static inline struct OAHT_CNAME(_bucket) *
+OAHT_CNAME(_buckets)(struct OAHT_CUCKOO_PREFIX *c) {
+	return (struct OAHT_CNAME(_bucket) *)
+		(((size_t)(c + 1) + OAHT_CACHE_LINE - 1) &
+		 ~(size_t)(OAHT_CACHE_LINE - 1));
+}
+
+/* Size to allocate for a set with mask mask. Used internally. */
+static inline size_t
+OAHT_CNAME(_sizeof)(OAHT_SIZE_T mask) {
+	return sizeof(struct OAHT_CUCKOO_PREFIX) + OAHT_CACHE_LINE - 1 +
+		((size_t)mask + 1) * sizeof(struct OAHT_CNAME(_bucket));
+}
+
+/* Returns the hash of a key. Used internally. */
+static inline OAHT_HASH_T
+OAHT_CNAME(_hash)(struct OAHT_CUCKOO_PREFIX *c, OAHT_KEY_T key) {
+	#ifdef OAHT_HASH_FN
+	return (OAHT_HASH_T)OAHT_HASH_FN(key, c->seed);
+	#else
+	(void)c;
+	return OAHT_HASH(key);
+	#endif
+}
+
+/*
+ * Mixes the bits of a hash (the finalizer of splitmix64), since the buckets
+ * must be independent of each other even for a weak hash function, such as
+ * the identity for integer keys. Used internally.
+ */
+static inline unsigned long long
+OAHT_CNAME(_mix)(OAHT_HASH_T hash) {
+	unsigned long long h = (unsigned long long)hash;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+/* The first bucket of a key with this hash. Used internally. */
+static inline OAHT_SIZE_T
+OAHT_CNAME(_first)(OAHT_SIZE_T mask, OAHT_HASH_T hash) {
+	return (OAHT_SIZE_T)OAHT_CNAME(_mix)(hash) & mask;
+}
+
+/*
+ * The other bucket of a key with this hash, which is in the bucket b. The
+ * bucket is changed by an odd number taken from the high bits of the mixed
+ * hash, so the two buckets differ and each is the other one of the other.
+ * Used internally.
+ */
+static inline OAHT_SIZE_T
+OAHT_CNAME(_alt)(OAHT_SIZE_T mask, OAHT_SIZE_T b, OAHT_HASH_T hash) {
+	return (b ^ ((OAHT_SIZE_T)(OAHT_CNAME(_mix)(hash) >> 32) | 1)) & mask;
+}
+
+/*
+ * Check if a bucket holds a key, comparing all the slots without branching
+ * on the result of each, so OAHT_KEY_EQUALS is applied to the empty slots too.
+ * Used internally.
+ */
+static inline int
+OAHT_CNAME(_bucket_has)(struct OAHT_CNAME(_bucket) *b, OAHT_KEY_T key) {
+	int i, found = 0;
+	for (i = 0; i < OAHT_CUCKOO_SLOTS; i++)
+		found |= !OAHT_IS_EMPTY_KEY(b->keys[i]) &
+			!!OAHT_KEY_EQUALS(b->keys[i], key);
+	return found;
+}
+
+/*
+ * Stores a key in an EMPTY slot of a bucket. Returns 1 if it did, 0 if the
+ * bucket is full. Used internally.
+ */
+static inline int
+OAHT_CNAME(_bucket_store)(struct OAHT_CNAME(_bucket) *b, OAHT_KEY_T key) {
+	int i;
+	for (i = 0; i < OAHT_CUCKOO_SLOTS; i++) {
+		if (OAHT_IS_EMPTY_KEY(b->keys[i])) {
+			b->keys[i] = key;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Allocates an empty set with mask + 1 buckets and the seed seed (which is
+ * ignored without OAHT_HASH_FN). Used internally.
+ */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_alloc)(OAHT_SIZE_T mask, unsigned long long seed) {
+	struct OAHT_CUCKOO_PREFIX *c = (struct OAHT_CUCKOO_PREFIX *)
+		OAHT_ALLOC(OAHT_CNAME(_sizeof)(mask));
+	struct OAHT_CNAME(_bucket) *buckets;
+	if (!c) OAHT_OOM();
+	c->used = 0;
+	c->mask = mask;
+	c->rng = 1;
+	#ifdef OAHT_HASH_FN
+	c->seed = seed;
+	#else
+	(void)seed;
+	#endif
+	buckets = OAHT_CNAME(_buckets)(c);
+	#ifdef OAHT_EMPTY_KEY_BYTE
+	memset(buckets, OAHT_EMPTY_KEY_BYTE,
+	       ((size_t)mask + 1) * sizeof(struct OAHT_CNAME(_bucket)));
+	#else
+	{
+		OAHT_SIZE_T i;
+		int j;
+		for (i = 0; i <= mask; i++)
+			for (j = 0; j < OAHT_CUCKOO_SLOTS; j++)
+				buckets[i].keys[j] = OAHT_EMPTY_KEY;
+	}
+	#endif
+	return c;
+}
+
+/*
+ * Places a key which isn't in the set, moving other keys if both its buckets
+ * are full. Returns 1 if all keys were placed. Otherwise, after
+ * OAHT_CUCKOO_MAX_KICKS moves, returns 0 and sets *key to the key which was
+ * moved out last, which is then not in the set. Doesn't update used. Used
+ * internally.
+ */
+static inline int
+OAHT_CNAME(_place)(struct OAHT_CUCKOO_PREFIX *c, OAHT_KEY_T *key,
+                   OAHT_HASH_T hash) {
+	struct OAHT_CNAME(_bucket) *buckets = OAHT_CNAME(_buckets)(c);
+	OAHT_KEY_T k = *key, moved;
+	OAHT_SIZE_T b = OAHT_CNAME(_first)(c->mask, hash);
+	OAHT_SIZE_T alt = OAHT_CNAME(_alt)(c->mask, b, hash);
+	unsigned kicks, i;
+	if (OAHT_CNAME(_bucket_store)(&buckets[b], k) ||
+	    OAHT_CNAME(_bucket_store)(&buckets[alt], k))
+		return 1;
+	for (kicks = 0; kicks < OAHT_CUCKOO_MAX_KICKS; kicks++) {
+		/* xorshift, to move a random key of either bucket */
+		c->rng ^= c->rng << 13;
+		c->rng ^= c->rng >> 17;
+		c->rng ^= c->rng << 5;
+		if (kicks == 0 && (c->rng & OAHT_CUCKOO_SLOTS))
+			b = alt;
+		i = c->rng & (OAHT_CUCKOO_SLOTS - 1);
+		moved = buckets[b].keys[i];
+		buckets[b].keys[i] = k;
+		k = moved;
+		b = OAHT_CNAME(_alt)(c->mask, b, OAHT_CNAME(_hash)(c, k));
+		if (OAHT_CNAME(_bucket_store)(&buckets[b], k))
+			return 1;
+	}
+	*key = k;
+	return 0;
+}
+
+/* The mask for n keys at the maximum load. Used internally. */
+static inline OAHT_SIZE_T
+OAHT_CNAME(_mask_for)(OAHT_SIZE_T n) {
+	OAHT_SIZE_T mask = 0;
+	while (((unsigned long long)mask + 1) * OAHT_CUCKOO_SLOTS *
+	       OAHT_CUCKOO_MAX_LOAD_NUM < (unsigned long long)n *
+	       OAHT_CUCKOO_MAX_LOAD_DEN)
+		mask = mask * 2 + 1;
+	return mask;
+}
+
+/*
+ * Moves the keys of c, and key unless it's EMPTY, to a new set with at least
+ * mask + 1 buckets. If they don't fit, the number of buckets is doubled until
+ * they do. Frees c and returns the new set. Used internally.
+ */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_rehash)(struct OAHT_CUCKOO_PREFIX *c, OAHT_SIZE_T mask,
+                    OAHT_KEY_T key) {
+	struct OAHT_CNAME(_bucket) *buckets = OAHT_CNAME(_buckets)(c);
+	unsigned long long seed = 0;
+	#ifdef OAHT_HASH_FN
+	int reseeded = 0;
+	seed = c->seed;
+	#endif
+	for (;; mask = mask * 2 + 1) {
+		struct OAHT_CUCKOO_PREFIX *d = OAHT_CNAME(_alloc)(mask, seed);
+		OAHT_SIZE_T i;
+		OAHT_KEY_T k;
+		int j, ok = 1;
+		for (i = 0; ok && i <= c->mask; i++) {
+			for (j = 0; ok && j < OAHT_CUCKOO_SLOTS; j++) {
+				k = buckets[i].keys[j];
+				if (!OAHT_IS_EMPTY_KEY(k))
+					ok = OAHT_CNAME(_place)(d, &k, OAHT_CNAME(_hash)(d, k));
+			}
+		}
+		k = key;
+		if (ok && !OAHT_IS_EMPTY_KEY(k))
+			ok = OAHT_CNAME(_place)(d, &k, OAHT_CNAME(_hash)(d, k));
+		if (ok) {
+			d->used = c->used + !OAHT_IS_EMPTY_KEY(key);
+			OAHT_FREE(c, OAHT_CNAME(_sizeof)(c->mask));
+			return d;
+		}
+		OAHT_FREE(d, OAHT_CNAME(_sizeof)(d->mask));
+		/*
+		 * Far below the maximum load, they don't fit because more than
+		 * 2 * OAHT_CUCKOO_SLOTS keys have the same hash, so more room
+		 * won't help. A new seed may, once.
+		 */
+		if (((unsigned long long)mask + 1) * OAHT_CUCKOO_SLOTS >
+		    64 * ((unsigned long long)c->used + 1)) {
+			#ifdef OAHT_HASH_FN
+			if (!reseeded++) {
+				seed = OAHT_SEED(c);
+				mask = OAHT_CNAME(_mask_for)(c->used + 1) / 2;
+				continue;
+			}
+			#endif
+			OAHT_OOM();
+		}
+	}
+}
+
+/* Creates an empty set. */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_create)(void) {
+	struct OAHT_CUCKOO_PREFIX *c = OAHT_CNAME(_alloc)(1, 0);
+	#ifdef OAHT_HASH_FN
+	c->seed = OAHT_SEED(c);
+	#endif
+	return c;
+}
+
+/* Frees the memory. */
+static inline void
+OAHT_CNAME(_destroy)(struct OAHT_CUCKOO_PREFIX *c) {
+	OAHT_FREE(c, OAHT_CNAME(_sizeof)(c->mask));
+}
+
+/* Returns the number of keys. */
+static inline OAHT_SIZE_T
+OAHT_CNAME(_len)(struct OAHT_CUCKOO_PREFIX *c) {
+	return c->used;
+}
+
+/*
+ * Check if a key exists. Returns 1 if it does, 0 if it doesn't. Both buckets
+ * are read, so the two memory accesses overlap.
+ */
+static inline int
+OAHT_CNAME(_contains)(struct OAHT_CUCKOO_PREFIX *c, OAHT_KEY_T key) {
+	struct OAHT_CNAME(_bucket) *buckets = OAHT_CNAME(_buckets)(c);
+	OAHT_HASH_T hash = OAHT_CNAME(_hash)(c, key);
+	OAHT_SIZE_T b = OAHT_CNAME(_first)(c->mask, hash);
+	OAHT_SIZE_T alt = OAHT_CNAME(_alt)(c->mask, b, hash);
+	return OAHT_CNAME(_bucket_has)(&buckets[b], key) |
+		OAHT_CNAME(_bucket_has)(&buckets[alt], key);
+}
+
+/*
+ * Make room for n keys in total, so that they can be inserted without
+ * growing, unless moving the keys fails. Returns a pointer to the same memory
+ * location or to a new memory location if the set has grown.
+ */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_reserve)(struct OAHT_CUCKOO_PREFIX *c, OAHT_SIZE_T n) {
+	OAHT_SIZE_T mask = OAHT_CNAME(_mask_for)(n);
+	if (mask <= c->mask)
+		return c;
+	return OAHT_CNAME(_rehash)(c, mask, OAHT_EMPTY_KEY);
+}
+
+/*
+ * Add a key to the set. Returns a pointer to the same memory location or to a
+ * new memory location if the set has grown, which it does when it's at the
+ * maximum load or when moving the keys fails.
+ */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_add)(struct OAHT_CUCKOO_PREFIX *c, OAHT_KEY_T key) {
+	OAHT_HASH_T hash;
+	if (OAHT_CNAME(_contains)(c, key))
+		return c;
+	if (OAHT_CNAME(_mask_for)(c->used + 1) > c->mask)
+		return OAHT_CNAME(_rehash)(c, c->mask * 2 + 1, key);
+	hash = OAHT_CNAME(_hash)(c, key);
+	if (!OAHT_CNAME(_place)(c, &key, hash))
+		return OAHT_CNAME(_rehash)(c, c->mask * 2 + 1, key);
+	c->used++;
+	return c;
+}
+
+/*
+ * Delete a key. Returns a pointer to the same memory location or to a new
+ * memory location if the set has shrunk, which it does when less than an
+ * eighth of the slots are used.
+ */
+static inline struct OAHT_CUCKOO_PREFIX *
+OAHT_CNAME(_delete)(struct OAHT_CUCKOO_PREFIX *c, OAHT_KEY_T key) {
+	struct OAHT_CNAME(_bucket) *buckets = OAHT_CNAME(_buckets)(c);
+	OAHT_HASH_T hash = OAHT_CNAME(_hash)(c, key);
+	OAHT_SIZE_T b = OAHT_CNAME(_first)(c->mask, hash);
+	int side, i;
+	for (side = 0; side < 2; side++) {
+		for (i = 0; i < OAHT_CUCKOO_SLOTS; i++) {
+			OAHT_KEY_T k = buckets[b].keys[i];
+			if (!OAHT_IS_EMPTY_KEY(k) && OAHT_KEY_EQUALS(k, key)) {
+				buckets[b].keys[i] = OAHT_EMPTY_KEY;
+				c->used--;
+				if (c->mask > 1 && ((unsigned long long)c->used * 8 <
+				    ((unsigned long long)c->mask + 1) * OAHT_CUCKOO_SLOTS))
+					return OAHT_CNAME(_rehash)(c, c->mask / 2,
+					                           OAHT_EMPTY_KEY);
+				return c;
+			}
+		}
+		b = OAHT_CNAME(_alt)(c->mask, b, hash);
+	}
+	return c;
+}
+
+/*
+ * Iterate over the keys. Start with pos = 0 and pass the return value as pos
+ * to get the next key. When 0 is returned, there are no more keys. Otherwise,
+ * the key is assigned to *k.
+ */
+static inline OAHT_SIZE_T
+OAHT_CNAME(_iter)(struct OAHT_CUCKOO_PREFIX *c, OAHT_SIZE_T pos, OAHT_KEY_T *k) {
+	struct OAHT_CNAME(_bucket) *buckets = OAHT_CNAME(_buckets)(c);
+	OAHT_SIZE_T end = (c->mask + 1) * OAHT_CUCKOO_SLOTS;
+	for (; pos < end; pos++) {
+		OAHT_KEY_T key = buckets[pos / OAHT_CUCKOO_SLOTS]
+			.keys[pos % OAHT_CUCKOO_SLOTS];
+		if (!OAHT_IS_EMPTY_KEY(key)) {
+			*k = key;
+			return pos + 1;
+		}
+	}
+	return 0;
+}
+
+#define OAHT_CUCKOO_H
+#endif
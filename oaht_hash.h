@@ -0,0 +1,182 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Viktor Söderqvist
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * oaht_hash.h - Seeded hash functions for the keys of the hashtables
+ *
+ * The functions take a key and a seed and return a 64-bit hash. All the bits
+ * of the key affect the low bits of the hash, which are used for the initial
+ * probes, so keys which only differ in their high bits (such as multiples of
+ * a power of two) don't collide. They're built on a 64 x 64 -> 128 bit
+ * multiplication, folded to 64 bits, like wyhash.
+ *
+ * Use one for a table by defining OAHT_HASH_FN before including oaht.h, which
+ * then includes this file and gives each table a seed:
+ *
+ *     #define OAHT_HASH_FN(key, seed) oaht_hash_u64(key, seed)
+ */
+
+#ifndef OAHT_HASH_H
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE4_2__) && defined(__x86_64__)
+	#include <nmmintrin.h>
+	#define OAHT_HASH_HAVE_CRC32C
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+	#include <arm_acle.h>
+	#define OAHT_HASH_HAVE_CRC32C
+#endif
+
+/* The constants of wyhash. Used internally. */
+#define OAHT_HASH_P0 0xa0761d6478bd642fULL
+#define OAHT_HASH_P1 0xe7037ed1a0b428dbULL
+#define OAHT_HASH_P2 0x8ebc6af09c88c6e3ULL
+
+#if defined(__SIZEOF_INT128__)
+/* __extension__ keeps -pedantic quiet about the non-ISO type */
+__extension__ typedef unsigned __int128 oaht_hash_u128;
+#endif
+
+/*
+ * Multiplies a and b to 128 bits and returns the two halves xor'ed. Used
+ * internally.
+ */
+static inline unsigned long long
+oaht_hash_mum(unsigned long long a, unsigned long long b) {
+	#if defined(__SIZEOF_INT128__)
+	oaht_hash_u128 r = (oaht_hash_u128)a * b;
+	return (unsigned long long)r ^ (unsigned long long)(r >> 64);
+	#else
+	unsigned long long ha = a >> 32, la = a & 0xffffffffULL;
+	unsigned long long hb = b >> 32, lb = b & 0xffffffffULL;
+	unsigned long long hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+	unsigned long long mid = hl + (ll >> 32) + (lh & 0xffffffffULL);
+	unsigned long long lo = (mid << 32) | (ll & 0xffffffffULL);
+	unsigned long long hi = hh + (mid >> 32) + (lh >> 32);
+	return lo ^ hi;
+	#endif
+}
+
+/* Reads 8 and 4 bytes in the native byte order. Used internally. */
+static inline unsigned long long
+oaht_hash_read64(const unsigned char *p) {
+	unsigned long long v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline unsigned long long
+oaht_hash_read32(const unsigned char *p) {
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/* Hashes a 64-bit integer. */
+static inline unsigned long long
+oaht_hash_u64(unsigned long long key, unsigned long long seed) {
+	return oaht_hash_mum(oaht_hash_mum(key ^ seed ^ OAHT_HASH_P0,
+	                                   OAHT_HASH_P1) ^ seed,
+	                     OAHT_HASH_P2);
+}
+
+/* Hashes a 32-bit integer. */
+static inline unsigned long long
+oaht_hash_u32(unsigned int key, unsigned long long seed) {
+	return oaht_hash_u64(key, seed);
+}
+
+/* Hashes len bytes. */
+static inline unsigned long long
+oaht_hash_bytes(const void *key, size_t len, unsigned long long seed) {
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned long long a, b, n = len;
+	seed ^= OAHT_HASH_P0;
+	for (; len > 16; len -= 16, p += 16)
+		seed = oaht_hash_mum(oaht_hash_read64(p) ^ OAHT_HASH_P1,
+		                     oaht_hash_read64(p + 8) ^ seed);
+	if (len >= 8) {
+		a = oaht_hash_read64(p);
+		b = oaht_hash_read64(p + len - 8);
+	} else if (len >= 4) {
+		a = oaht_hash_read32(p);
+		b = oaht_hash_read32(p + len - 4);
+	} else if (len > 0) {
+		a = (unsigned long long)p[0] << 16 | p[len / 2] << 8 | p[len - 1];
+		b = 0;
+	} else {
+		a = b = 0;
+	}
+	return oaht_hash_mum(OAHT_HASH_P1 ^ n,
+	                     oaht_hash_mum(a ^ OAHT_HASH_P1, b ^ seed));
+}
+
+/* Hashes a nul-terminated string. */
+static inline unsigned long long
+oaht_hash_str(const char *key, unsigned long long seed) {
+	return oaht_hash_bytes(key, strlen(key), seed);
+}
+
+#ifdef OAHT_HASH_HAVE_CRC32C
+/*
+ * Hashes a 64-bit integer using the CRC32C instruction of SSE 4.2 or ARMv8,
+ * which is faster than oaht_hash_u64. The CRC is multiplied by a constant to
+ * spread it over the high bits. Only defined if OAHT_HASH_HAVE_CRC32C is.
+ *
+ * CRC32C is linear, so keys which collide do so for every seed. Use it with
+ * trusted keys only.
+ */
+static inline unsigned long long
+oaht_hash_crc32c_u64(unsigned long long key, unsigned long long seed) {
+	#if defined(__SSE4_2__)
+	unsigned long long crc = _mm_crc32_u64(seed, key);
+	#else
+	unsigned long long crc = __crc32cd((unsigned int)seed, key);
+	#endif
+	return (crc | crc << 32) * OAHT_HASH_P0;
+}
+#endif
+
+/*
+ * Returns a seed for a new table. It's derived from the address of the table,
+ * a counter and the address of the counter, which differs between runs when
+ * the address space is randomized. Different tables get different seeds, but
+ * the seeds are not unpredictable.
+ */
+static inline unsigned long long
+oaht_hash_seed(const void *table) {
+	static unsigned long long counter;
+	#if defined(__GNUC__)
+	unsigned long long c = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+	#else
+	unsigned long long c = ++counter;
+	#endif
+	return oaht_hash_u64((unsigned long long)(size_t)table,
+	                     (unsigned long long)(size_t)&counter ^ c);
+}
+
+#define OAHT_HASH_H
+#endif
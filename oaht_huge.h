@@ -0,0 +1,211 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Viktor Söderqvist
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * oaht_huge.h - An allocator using huge pages for large hashtables
+ *
+ * The lookups of a large table probe random slots, so each of them needs a TLB
+ * entry of its own and with 4K pages most of them miss the TLB. Blocks of at
+ * least OAHT_HUGE_MIN_SIZE bytes are therefore mapped using mmap, aligned to
+ * and rounded up to OAHT_HUGE_PAGE_SIZE, and backed by huge pages: explicit
+ * ones (MAP_HUGETLB) if OAHT_HUGE_TLB is defined and there are enough of them
+ * reserved, otherwise transparent ones (madvise MADV_HUGEPAGE). The pages can
+ * also be interleaved over or bound to NUMA nodes. Smaller blocks use malloc.
+ *
+ * Use it for the tables by defining the allocation macros before including
+ * oaht.h:
+ *
+ *     #define OAHT_ALLOC(size) oaht_huge_alloc(size)
+ *     #define OAHT_REALLOC(ptr, size, oldsize) \
+ *             oaht_huge_realloc(ptr, size, oldsize)
+ *     #define OAHT_FREE(ptr, size) oaht_huge_free(ptr, size)
+ *
+ * Huge pages and NUMA placement are only available on Linux. Elsewhere, the
+ * large blocks are mapped using 4K pages.
+ */
+
+#ifndef OAHT_HUGE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+	#include <unistd.h>
+	#include <sys/syscall.h>
+#endif
+/* syscall, for mbind, is declared by glibc with _DEFAULT_SOURCE */
+#if defined(SYS_mbind) && (defined(_DEFAULT_SOURCE) || defined(_GNU_SOURCE))
+	#define OAHT_HUGE_SYSCALL 1
+#else
+	#define OAHT_HUGE_SYSCALL 0
+#endif
+
+/* Blocks of at least this many bytes are mapped. Defaults to 4 MB. */
+#ifndef OAHT_HUGE_MIN_SIZE
+	#define OAHT_HUGE_MIN_SIZE (4UL << 20)
+#endif
+
+/* The size of the huge pages. Defaults to 2 MB. */
+#ifndef OAHT_HUGE_PAGE_SIZE
+	#define OAHT_HUGE_PAGE_SIZE (2UL << 20)
+#endif
+
+/*
+ * NUMA placement. If OAHT_HUGE_NODES is defined, it's a bit mask of NUMA
+ * nodes, e.g. 0x3 for nodes 0 and 1, and the pages of the mapped blocks are
+ * interleaved over the nodes, or allocated on them if OAHT_HUGE_MPOL is
+ * defined to OAHT_HUGE_MPOL_BIND. This uses the mbind system call, so libnuma
+ * isn't needed, and _DEFAULT_SOURCE or _GNU_SOURCE for syscall. It's best
+ * effort: if mbind fails or isn't available, the default policy is used.
+ */
+#define OAHT_HUGE_MPOL_BIND 2
+#define OAHT_HUGE_MPOL_INTERLEAVE 3
+#ifndef OAHT_HUGE_MPOL
+	#define OAHT_HUGE_MPOL OAHT_HUGE_MPOL_INTERLEAVE
+#endif
+
+/*
+ * Anonymous mappings aren't in ISO C or POSIX before 2024, so e.g. glibc only
+ * declares them with _DEFAULT_SOURCE, which -std=c99 leaves undefined. Without
+ * them, OAHT_HUGE_NO_MMAP is defined and all blocks use malloc.
+ */
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+	#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifndef MAP_ANONYMOUS
+	#define OAHT_HUGE_NO_MMAP
+#endif
+
+/* Checks if a block of size bytes is mapped. Used internally. */
+static inline int
+oaht_huge_is_mapped(size_t size) {
+	#ifdef OAHT_HUGE_NO_MMAP
+	(void)size;
+	return 0;
+	#else
+	return size >= OAHT_HUGE_MIN_SIZE;
+	#endif
+}
+
+/* The size of a mapped block, in whole huge pages. Used internally. */
+static inline size_t
+oaht_huge_mapped_size(size_t size) {
+	return (size + OAHT_HUGE_PAGE_SIZE - 1) & ~(OAHT_HUGE_PAGE_SIZE - 1);
+}
+
+#ifndef OAHT_HUGE_NO_MMAP
+/*
+ * Maps len bytes, a multiple of OAHT_HUGE_PAGE_SIZE, aligned to a huge page.
+ * Returns NULL if it fails. Used internally.
+ */
+static inline void *
+oaht_huge_map(size_t len) {
+	char *p, *aligned;
+	size_t head;
+	#if defined(__linux__) && defined(OAHT_HUGE_TLB) && defined(MAP_HUGETLB)
+	p = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED)
+		return p;
+	#endif
+	/* map one huge page more and unmap the parts outside the aligned block */
+	p = (char *)mmap(NULL, len + OAHT_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	aligned = (char *)(((size_t)p + OAHT_HUGE_PAGE_SIZE - 1) &
+	                   ~(OAHT_HUGE_PAGE_SIZE - 1));
+	head = (size_t)(aligned - p);
+	if (head)
+		munmap(p, head);
+	munmap(aligned + len, OAHT_HUGE_PAGE_SIZE - head);
+	#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	madvise(aligned, len, MADV_HUGEPAGE);
+	#endif
+	return aligned;
+}
+#endif
+
+/* Allocates size bytes. Returns NULL if it fails. */
+static inline void *
+oaht_huge_alloc(size_t size) {
+	#ifdef OAHT_HUGE_NO_MMAP
+	return malloc(size);
+	#else
+	void *p;
+	size_t len;
+	if (!oaht_huge_is_mapped(size))
+		return malloc(size);
+	len = oaht_huge_mapped_size(size);
+	p = oaht_huge_map(len);
+	#if defined(__linux__) && defined(OAHT_HUGE_NODES) && OAHT_HUGE_SYSCALL
+	if (p) {
+		unsigned long nodes = OAHT_HUGE_NODES;
+		/* before the pages are touched, so that they're placed on the nodes */
+		syscall(SYS_mbind, p, len, OAHT_HUGE_MPOL, &nodes,
+		        sizeof(nodes) * 8, 0);
+	}
+	#endif
+	return p;
+	#endif
+}
+
+/* Frees a block of size bytes. */
+static inline void
+oaht_huge_free(void *ptr, size_t size) {
+	if (!ptr)
+		return;
+	if (!oaht_huge_is_mapped(size))
+		free(ptr);
+	#ifndef OAHT_HUGE_NO_MMAP
+	else
+		munmap(ptr, oaht_huge_mapped_size(size));
+	#endif
+}
+
+/*
+ * Resizes a block of oldsize bytes to size bytes. Returns NULL if it fails,
+ * and the block is then unchanged. A mapped block is copied to a new
+ * block, unless both sizes round up to the same number of huge pages.
+ */
+static inline void *
+oaht_huge_realloc(void *ptr, size_t size, size_t oldsize) {
+	void *p;
+	if (!ptr)
+		return oaht_huge_alloc(size);
+	if (!oaht_huge_is_mapped(size) && !oaht_huge_is_mapped(oldsize))
+		return realloc(ptr, size);
+	if (oaht_huge_is_mapped(size) && oaht_huge_is_mapped(oldsize) &&
+	    oaht_huge_mapped_size(size) == oaht_huge_mapped_size(oldsize))
+		return ptr;
+	p = oaht_huge_alloc(size);
+	if (!p)
+		return NULL;
+	memcpy(p, ptr, size < oldsize ? size : oldsize);
+	oaht_huge_free(ptr, oldsize);
+	return p;
+}
+
+#define OAHT_HUGE_H
+#endif
@@ -0,0 +1,211 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Viktor Söderqvist
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * oaht_pool.h - A pool allocator for many small hashtables
+ *
+ * Small blocks are rounded up to a power of two (a size class) and carved out
+ * of larger slabs. Freed blocks are kept in a free list per size class and
+ * reused by the next allocation of the same class, so creating and destroying
+ * small tables doesn't call malloc and free. Larger blocks use malloc.
+ *
+ * The pool is per thread. A block may be freed by another thread than the one
+ * which allocated it; it is then reused by the thread which freed it. The
+ * slabs are only given back by oaht_pool_clear.
+ *
+ * Use it for the tables by defining the allocation macros before including
+ * oaht.h:
+ *
+ *     #define OAHT_ALLOC(size) oaht_pool_alloc(size)
+ *     #define OAHT_REALLOC(ptr, size, oldsize) \
+ *             oaht_pool_realloc(ptr, size, oldsize)
+ *     #define OAHT_FREE(ptr, size) oaht_pool_free(ptr, size)
+ */
+
+#ifndef OAHT_POOL_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The size classes are OAHT_POOL_MIN_SIZE times powers of two, up to
+ * OAHT_POOL_CLASSES classes. OAHT_POOL_MIN_SIZE must be a power of two, at
+ * least the size of a pointer and at least the alignment of the tables.
+ * Defaults to 16 and 9 classes, i.e. blocks of up to 4096 bytes.
+ */
+#ifndef OAHT_POOL_MIN_SIZE
+	#define OAHT_POOL_MIN_SIZE 16
+#endif
+#ifndef OAHT_POOL_CLASSES
+	#define OAHT_POOL_CLASSES 9
+#endif
+
+/* The size of the slabs allocated using malloc. */
+#ifndef OAHT_POOL_SLAB_SIZE
+	#define OAHT_POOL_SLAB_SIZE 65536
+#endif
+
+/*
+ * Storage class of the pool. Defaults to thread-local storage. Define it as
+ * empty to use a single pool when there is only one thread.
+ */
+#ifndef OAHT_POOL_THREAD_LOCAL
+	#if defined(__GNUC__)
+		#define OAHT_POOL_THREAD_LOCAL __thread
+	#else
+		#define OAHT_POOL_THREAD_LOCAL _Thread_local
+	#endif
+#endif
+
+#if OAHT_POOL_SLAB_SIZE < OAHT_POOL_MIN_SIZE << (OAHT_POOL_CLASSES - 1)
+	#error "OAHT_POOL_SLAB_SIZE must fit a block of the largest size class"
+#endif
+
+/* A free block, linked to the next free block of its class. Used internally. */
+struct oaht_pool_block {
+	struct oaht_pool_block *next;
+};
+
+/*
+ * A slab. The blocks follow the header, which is padded to keep them aligned.
+ * Used internally.
+ */
+union oaht_pool_slab {
+	union oaht_pool_slab *next;
+	char pad[OAHT_POOL_MIN_SIZE];
+};
+
+/* The pool of a thread. Used internally. */
+struct oaht_pool {
+	struct oaht_pool_block *free[OAHT_POOL_CLASSES];
+	union oaht_pool_slab *slabs;
+	char *next, *end; /* unused memory of the last slab */
+};
+
+static OAHT_POOL_THREAD_LOCAL struct oaht_pool oaht_pool_local;
+
+/*
+ * Returns the size class of a block, or OAHT_POOL_CLASSES if it's too large
+ * for the pool. Used internally.
+ */
+static inline unsigned
+oaht_pool_class(size_t size) {
+	unsigned c = 0;
+	while (c < OAHT_POOL_CLASSES && (size_t)OAHT_POOL_MIN_SIZE << c < size)
+		c++;
+	return c;
+}
+
+/* Allocates size bytes. Returns NULL if out of memory. */
+static inline void *
+oaht_pool_alloc(size_t size) {
+	struct oaht_pool *p = &oaht_pool_local;
+	unsigned c = oaht_pool_class(size);
+	size_t block_size = (size_t)OAHT_POOL_MIN_SIZE << c;
+	void *ptr;
+	if (c == OAHT_POOL_CLASSES)
+		return malloc(size);
+	if (p->free[c]) {
+		ptr = p->free[c];
+		p->free[c] = p->free[c]->next;
+		return ptr;
+	}
+	if ((size_t)(p->end - p->next) < block_size) {
+		/* The rest of the last slab is given to the smaller classes. */
+		union oaht_pool_slab *slab;
+		while (p->next != p->end) {
+			size_t rest = (size_t)(p->end - p->next);
+			unsigned r = oaht_pool_class(rest);
+			struct oaht_pool_block *b;
+			if ((size_t)OAHT_POOL_MIN_SIZE << r > rest)
+				r--;
+			b = (struct oaht_pool_block *)p->next;
+			b->next = p->free[r];
+			p->free[r] = b;
+			p->next += (size_t)OAHT_POOL_MIN_SIZE << r;
+		}
+		slab = (union oaht_pool_slab *)malloc(OAHT_POOL_SLAB_SIZE);
+		if (!slab)
+			return NULL;
+		slab->next = p->slabs;
+		p->slabs = slab;
+		p->next = (char *)(slab + 1);
+		p->end = (char *)slab + OAHT_POOL_SLAB_SIZE;
+	}
+	ptr = p->next;
+	p->next += block_size;
+	return ptr;
+}
+
+/* Frees a block of size bytes, allocated using the pool. */
+static inline void
+oaht_pool_free(void *ptr, size_t size) {
+	struct oaht_pool *p = &oaht_pool_local;
+	unsigned c = oaht_pool_class(size);
+	struct oaht_pool_block *b = (struct oaht_pool_block *)ptr;
+	if (!ptr)
+		return;
+	if (c == OAHT_POOL_CLASSES) {
+		free(ptr);
+		return;
+	}
+	b->next = p->free[c];
+	p->free[c] = b;
+}
+
+/*
+ * Resizes a block allocated using the pool. The block is kept if the size
+ * class is the same. Returns NULL if out of memory, leaving the old block.
+ */
+static inline void *
+oaht_pool_realloc(void *ptr, size_t size, size_t oldsize) {
+	unsigned c = oaht_pool_class(size), oldc = oaht_pool_class(oldsize);
+	void *newptr;
+	if (c == oldc && ptr)
+		return c == OAHT_POOL_CLASSES ? realloc(ptr, size) : ptr;
+	newptr = oaht_pool_alloc(size);
+	if (!newptr || !ptr)
+		return newptr;
+	memcpy(newptr, ptr, size < oldsize ? size : oldsize);
+	oaht_pool_free(ptr, oldsize);
+	return newptr;
+}
+
+/*
+ * Frees the slabs of the calling thread's pool. Must only be called when no
+ * block from them is used or kept in the free list of another thread.
+ */
+static inline void
+oaht_pool_clear(void) {
+	struct oaht_pool *p = &oaht_pool_local;
+	while (p->slabs) {
+		union oaht_pool_slab *next = p->slabs->next;
+		free(p->slabs);
+		p->slabs = next;
+	}
+	memset(p, 0, sizeof(*p));
+}
+
+#define OAHT_POOL_H
+#endif
@@ -0,0 +1,310 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2013 Viktor Söderqvist
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * oaht_sharded.h - A hash table for many threads, made of oaht.h tables
+ *
+ * The keys are distributed over 2^OAHT_SHARD_BITS tables (shards) by a mix of
+ * their hash. Each shard has its own lock, so threads using different
+ * shards don't wait for each other and a resize only stalls one shard.
+ *
+ * The shards are oaht.h tables, configured by the same macros. They are
+ * included from here unless oaht.h has already been included for them.
+ */
+
+#ifndef OAHT_SHARDED_H
+
+#ifndef OAHT_H
+	#include "oaht.h"
+#endif
+
+/*
+ * Generics: prefix to use for the sharded table. The shards use OAHT_PREFIX.
+ * Defaults to oaht_sharded.
+ */
+#ifndef OAHT_SHARDED_PREFIX
+	#define OAHT_SHARDED_PREFIX oaht_sharded
+#endif
+
+#undef OAHT_SNAME
+#define OAHT_SNAME(name) OAHT_XNAME(OAHT_SHARDED_PREFIX, name)
+
+/* The number of shards is 2^OAHT_SHARD_BITS. */
+#ifndef OAHT_SHARD_BITS
+	#define OAHT_SHARD_BITS 6
+#endif
+
+/*
+ * The shard of a hash. Defaults to the highest OAHT_SHARD_BITS bits of the
+ * hash mixed by _mix, so that keys differing only in their low bits, such as
+ * consecutive integers hashed by the identity, are spread over the shards.
+ */
+#ifndef OAHT_SHARD
+	#define OAHT_SHARD(hash) \
+		((unsigned)(OAHT_SNAME(_mix)(hash) >> (64 - OAHT_SHARD_BITS)))
+#endif
+
+#ifndef OAHT_CACHE_LINE
+	#define OAHT_CACHE_LINE 64
+#endif
+
+/*
+ * Lock macros. Default to a pthread mutex, or a spinlock using the __atomic
+ * builtins of GCC and Clang if OAHT_SPINLOCK is defined.
+ */
+#ifndef OAHT_LOCK_T
+	#ifdef OAHT_SPINLOCK
+		#define OAHT_LOCK_T int
+		#define OAHT_LOCK_INIT(l) (*(l) = 0)
+		#define OAHT_LOCK_DESTROY(l) ((void)(l))
+		#define OAHT_LOCK(l) \
+			while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) \
+				while (__atomic_load_n(l, __ATOMIC_RELAXED))
+		#define OAHT_UNLOCK(l) __atomic_store_n(l, 0, __ATOMIC_RELEASE)
+	#else
+		#include <pthread.h>
+		#define OAHT_LOCK_T pthread_mutex_t
+		#define OAHT_LOCK_INIT(l) pthread_mutex_init(l, NULL)
+		#define OAHT_LOCK_DESTROY(l) pthread_mutex_destroy(l)
+		#define OAHT_LOCK(l) pthread_mutex_lock(l)
+		#define OAHT_UNLOCK(l) pthread_mutex_unlock(l)
+	#endif
+#endif
+
+/* A shard and its lock, in cache lines of their own. Used internally. */
+struct OAHT_SNAME(_shard) {
+	OAHT_LOCK_T lock;
+	struct OAHT_PREFIX *table;
+	char pad[OAHT_CACHE_LINE];
+};
+
+/* The sharded hashtable type */
+struct OAHT_SHARDED_PREFIX {
+	struct OAHT_SNAME(_shard) shards[1 << OAHT_SHARD_BITS];
+	#ifdef OAHT_HASH_FN
+	unsigned long long seed; /* the seed of the shards */
+	#endif
+};
+
+/* A position for iterating, starting at all zeros */
+struct OAHT_SNAME(_cursor) {
+	unsigned shard;
+	OAHT_SIZE_T pos;
+};
+
+/*
+ * Returns the hash of a key, which chooses its shard and is then passed to the
+ * functions of the shard ending in _h, so that the key is hashed once. Used
+ * internally.
+ */
+static inline OAHT_HASH_T
+OAHT_SNAME(_hash)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key) {
+	#ifdef OAHT_HASH_FN
+	return (OAHT_HASH_T)OAHT_HASH_FN(key, s->seed);
+	#else
+	(void)s;
+	return OAHT_HASH(key);
+	#endif
+}
+
+/*
+ * Mixes all the bits of a hash into the high bits, using the finalizer of
+ * splitmix64. Used internally.
+ */
+static inline unsigned long long
+OAHT_SNAME(_mix)(OAHT_HASH_T hash) {
+	unsigned long long h = (unsigned long long)hash;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+/* Returns the shard of a hash. Used internally. */
+static inline struct OAHT_SNAME(_shard) *
+OAHT_SNAME(_shard_of)(struct OAHT_SHARDED_PREFIX *s, OAHT_HASH_T hash) {
+	return &s->shards[OAHT_SHARD(hash)];
+}
+
+/* Creates an empty sharded hashtable. */
+static inline struct OAHT_SHARDED_PREFIX *
+OAHT_SNAME(_create)(void) {
+	unsigned i;
+	struct OAHT_SHARDED_PREFIX *s =
+		(struct OAHT_SHARDED_PREFIX *)OAHT_ALLOC(sizeof(*s));
+	if (!s) OAHT_OOM();
+	#ifdef OAHT_HASH_FN
+	s->seed = OAHT_SEED(s);
+	#endif
+	for (i = 0; i < 1u << OAHT_SHARD_BITS; i++) {
+		OAHT_LOCK_INIT(&s->shards[i].lock);
+		s->shards[i].table = OAHT_NAME(_create)();
+		#ifdef OAHT_HASH_FN
+		/* the shards use the same seed, to use the same hashes */
+		s->shards[i].table->seed = s->seed;
+		#endif
+	}
+	return s;
+}
+
+/* Frees the memory. No other thread may use the table. */
+static inline void
+OAHT_SNAME(_destroy)(struct OAHT_SHARDED_PREFIX *s) {
+	unsigned i;
+	for (i = 0; i < 1u << OAHT_SHARD_BITS; i++) {
+		OAHT_NAME(_destroy)(s->shards[i].table);
+		OAHT_LOCK_DESTROY(&s->shards[i].lock);
+	}
+	OAHT_FREE(s, sizeof(*s));
+}
+
+/*
+ * Returns the number of entries. The shards are counted one at a time, so
+ * the result may be out of date when other threads modify the table.
+ */
+static inline OAHT_SIZE_T
+OAHT_SNAME(_len)(struct OAHT_SHARDED_PREFIX *s) {
+	OAHT_SIZE_T len = 0;
+	unsigned i;
+	for (i = 0; i < 1u << OAHT_SHARD_BITS; i++) {
+		OAHT_LOCK(&s->shards[i].lock);
+		len += OAHT_NAME(_len)(s->shards[i].table);
+		OAHT_UNLOCK(&s->shards[i].lock);
+	}
+	return len;
+}
+
+/* Check if a key exists. Returns 1 if it does, 0 if it doesn't. */
+static inline int
+OAHT_SNAME(_contains)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key) {
+	OAHT_HASH_T hash = OAHT_SNAME(_hash)(s, key);
+	struct OAHT_SNAME(_shard) *sh = OAHT_SNAME(_shard_of)(s, hash);
+	int found;
+	OAHT_LOCK(&sh->lock);
+	found = OAHT_NAME(_contains_h)(sh->table, key, hash);
+	OAHT_UNLOCK(&sh->lock);
+	return found;
+}
+
+#ifndef OAHT_NO_VALUE
+/*
+ * Fetch a value by its key. If it's not defined, default_value is returned.
+ */
+static inline OAHT_VALUE_T
+OAHT_SNAME(_get)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key,
+                 OAHT_VALUE_T default_value) {
+	OAHT_HASH_T hash = OAHT_SNAME(_hash)(s, key);
+	struct OAHT_SNAME(_shard) *sh = OAHT_SNAME(_shard_of)(s, hash);
+	OAHT_VALUE_T value;
+	OAHT_LOCK(&sh->lock);
+	value = OAHT_NAME(_get_h)(sh->table, key, hash, default_value);
+	OAHT_UNLOCK(&sh->lock);
+	return value;
+}
+
+/* Insert or replace the element at the given key. */
+static inline void
+OAHT_SNAME(_set)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key,
+                 OAHT_VALUE_T value) {
+	OAHT_HASH_T hash = OAHT_SNAME(_hash)(s, key);
+	struct OAHT_SNAME(_shard) *sh = OAHT_SNAME(_shard_of)(s, hash);
+	OAHT_LOCK(&sh->lock);
+	sh->table = OAHT_NAME(_set_h)(sh->table, key, hash, value);
+	OAHT_UNLOCK(&sh->lock);
+}
+#else
+/* Add an element (key) to the set. */
+static inline void
+OAHT_SNAME(_add)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key) {
+	OAHT_HASH_T hash = OAHT_SNAME(_hash)(s, key);
+	struct OAHT_SNAME(_shard) *sh = OAHT_SNAME(_shard_of)(s, hash);
+	OAHT_LOCK(&sh->lock);
+	sh->table = OAHT_NAME(_add_h)(sh->table, key, hash);
+	OAHT_UNLOCK(&sh->lock);
+}
+#endif
+
+/* Delete the given key. */
+static inline void
+OAHT_SNAME(_delete)(struct OAHT_SHARDED_PREFIX *s, OAHT_KEY_T key) {
+	OAHT_HASH_T hash = OAHT_SNAME(_hash)(s, key);
+	struct OAHT_SNAME(_shard) *sh = OAHT_SNAME(_shard_of)(s, hash);
+	OAHT_LOCK(&sh->lock);
+	sh->table = OAHT_NAME(_delete_h)(sh->table, key, hash);
+	OAHT_UNLOCK(&sh->lock);
+}
+
+/*
+ * Iterate over the keys and values, one shard at a time. Start with a cursor
+ * of all zeros. Returns 1 and assigns k and v if there is a next entry,
+ * otherwise 0. Entries inserted or deleted by other threads meanwhile may or
+ * may not be seen, and an entry may be seen twice if its shard is resized.
+ */
+static inline int
+OAHT_SNAME(_iter)(struct OAHT_SHARDED_PREFIX *s, struct OAHT_SNAME(_cursor) *c,
+                  OAHT_KEY_T *k, OAHT_VALUE_T *v) {
+	for (; c->shard < 1u << OAHT_SHARD_BITS; c->shard++, c->pos = 0) {
+		struct OAHT_SNAME(_shard) *sh = &s->shards[c->shard];
+		OAHT_LOCK(&sh->lock);
+		c->pos = OAHT_NAME(_iter)(sh->table, c->pos, k, v);
+		OAHT_UNLOCK(&sh->lock);
+		if (c->pos)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Scan the table a part at a time, using _scan of the shards. Each call scans
+ * one cursor position of one shard, holding only the lock of that shard, and
+ * calls fn for the entries found there. fn must not use the sharded table.
+ * Start with a cursor of all zeros. Returns 1 if there is more to scan,
+ * otherwise 0. Each entry which is in the table during the whole scan is
+ * visited at least once, even if the shards are resized meanwhile.
+ */
+static inline int
+#ifndef OAHT_NO_VALUE
+OAHT_SNAME(_scan)(struct OAHT_SHARDED_PREFIX *s, struct OAHT_SNAME(_cursor) *c,
+                  void (*fn)(void *arg, OAHT_KEY_T const *key,
+                             OAHT_VALUE_T *value),
+                  void *arg) {
+#else
+OAHT_SNAME(_scan)(struct OAHT_SHARDED_PREFIX *s, struct OAHT_SNAME(_cursor) *c,
+                  void (*fn)(void *arg, OAHT_KEY_T const *key), void *arg) {
+#endif
+	struct OAHT_SNAME(_shard) *sh;
+	if (c->shard >= 1u << OAHT_SHARD_BITS)
+		return 0;
+	sh = &s->shards[c->shard];
+	OAHT_LOCK(&sh->lock);
+	c->pos = OAHT_NAME(_scan)(sh->table, c->pos, fn, arg);
+	OAHT_UNLOCK(&sh->lock);
+	if (!c->pos)
+		c->shard++;
+	return c->shard < 1u << OAHT_SHARD_BITS;
+}
+
+#define OAHT_SHARDED_H
+#endif
@@ -1,3 +1,8 @@
+/* mkstemp, pthreads and mmap are POSIX, which -std=c99 doesn't declare */
+#if defined(__STRICT_ANSI__) && !defined(_POSIX_C_SOURCE)
+	#define _POSIX_C_SOURCE 200809L
+#endif
+
 #define OAHT_KEY_T int
 #define OAHT_VALUE_T int
 #define OAHT_HASH_T int
@@ -6,9 +11,308 @@
 #define OAHT_DELETED_KEY -1
 #include "oaht.h"
 
+/* A second hashtable type, using incremental resize */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX inc
+#define OAHT_INCREMENTAL_RESIZE
+#include "oaht.h"
+#undef OAHT_INCREMENTAL_RESIZE
+
+/* A hashtable type using backshift deletion, where -1 is a valid key */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX bs
+#define OAHT_BACKSHIFT_DELETE
+#include "oaht.h"
+
+/* Incremental resize with backshift deletion, and a hash making clusters */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_HASH
+#define OAHT_PREFIX incbs
+#define OAHT_HASH(x) ((x) & ~7)
+#define OAHT_INCREMENTAL_RESIZE
+#include "oaht.h"
+#undef OAHT_INCREMENTAL_RESIZE
+#undef OAHT_HASH
+#define OAHT_HASH(x) (x - 5)
+
+/* A hashtable type using Robin Hood probing */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX rh
+#define OAHT_ROBIN_HOOD
+#include "oaht.h"
+#undef OAHT_ROBIN_HOOD
+#undef OAHT_BACKSHIFT_DELETE
+
+/* A hashtable type using control bytes */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX cb
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+
+/* A hashtable type with a high load factor */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_MAX_LOAD_NUM
+#undef OAHT_MAX_LOAD_DEN
+#undef OAHT_GROWTH_FACTOR
+#define OAHT_PREFIX dense
+#define OAHT_MAX_LOAD_NUM 7
+#define OAHT_MAX_LOAD_DEN 8
+#define OAHT_GROWTH_FACTOR(used) 2
+#include "oaht.h"
+#undef OAHT_MAX_LOAD_NUM
+#undef OAHT_MAX_LOAD_DEN
+#undef OAHT_GROWTH_FACTOR
+
+/* A hashtable type with the values in a separate array */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX soa
+#define OAHT_VALUE_T double
+#define OAHT_SOA
+#include "oaht.h"
+#undef OAHT_SOA
+
+/* A hashtable type for one writer and concurrent readers */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX cr
+#define OAHT_VALUE_T int
+#define OAHT_CONCURRENT_READ
+#include "oaht.h"
+#undef OAHT_CONCURRENT_READ
+
+/* A sharded hashtable type, with the shards of type sh */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_HASH
+#define OAHT_PREFIX sh
+#define OAHT_HASH(x) (x)
+#define OAHT_SHARDED_PREFIX sharded
+#include "oaht_sharded.h"
+#undef OAHT_HASH
+#define OAHT_HASH(x) ((int)((unsigned)(x) * 2654435761u))
+
+/* A hashtable type growing large tables using 4 threads */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX par
+#define OAHT_PARALLEL_RESIZE
+#define OAHT_RESIZE_THREADS 4
+#undef OAHT_PARALLEL_MIN_USED
+#define OAHT_PARALLEL_MIN_USED 1000
+#include "oaht.h"
+#undef OAHT_RESIZE_THREADS
+#undef OAHT_PARALLEL_MIN_USED
+
+/* The same with backshift deletion and Robin Hood probing */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX par_rh
+#define OAHT_BACKSHIFT_DELETE
+#define OAHT_ROBIN_HOOD
+#include "oaht.h"
+#undef OAHT_ROBIN_HOOD
+#undef OAHT_BACKSHIFT_DELETE
+#undef OAHT_PARALLEL_RESIZE
+
+/* Small tables, counting the calls to the hash function */
+static int small_hashes;
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_HASH
+#define OAHT_PREFIX small
+#define OAHT_HASH(x) (small_hashes++, (int)(x))
+#define OAHT_SMALL_SIZE 16
+#include "oaht.h"
+#undef OAHT_SMALL_SIZE
+#undef OAHT_HASH
+
+/* Tables saved to and mapped from a file, and another type to compare with */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX mapped
+#define OAHT_MMAP
+#include "oaht.h"
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX mapped_dbl
+#define OAHT_VALUE_T double
+#include "oaht.h"
+#undef OAHT_VALUE_T
+#define OAHT_VALUE_T int
+#undef OAHT_MMAP
+
+/* A hashtable using the pool allocator */
+#include "oaht_pool.h"
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+#define OAHT_PREFIX pooled
+#define OAHT_ALLOC(size) oaht_pool_alloc(size)
+#define OAHT_REALLOC(ptr, size, oldsize) \
+	oaht_pool_realloc(ptr, size, oldsize)
+#define OAHT_FREE(ptr, size) oaht_pool_free(ptr, size)
+#include "oaht.h"
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+
+/* A hashtable using huge pages, for blocks from 64K so that tests use them */
+#define OAHT_HUGE_MIN_SIZE 65536
+#include "oaht_huge.h"
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX huge
+#define OAHT_ALLOC(size) oaht_huge_alloc(size)
+#define OAHT_REALLOC(ptr, size, oldsize) \
+	oaht_huge_realloc(ptr, size, oldsize)
+#define OAHT_FREE(ptr, size) oaht_huge_free(ptr, size)
+#include "oaht.h"
+#undef OAHT_ALLOC
+#undef OAHT_REALLOC
+#undef OAHT_FREE
+
+/* A set, without values */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX keyset
+#define OAHT_NO_VALUE
+#include "oaht.h"
+#undef OAHT_NO_VALUE
+
+/* A hashtable type using a seeded hash function, with a seed per table */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX seeded
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32((unsigned)(key), seed)
+#include "oaht.h"
+#undef OAHT_HASH_FN
+
+/* Cuckoo sets, hashed by the identity and by a seeded hash function */
+#define OAHT_CUCKOO_PREFIX cuckoo
+#include "oaht_cuckoo.h"
+
+#undef OAHT_CUCKOO_H
+#undef OAHT_CUCKOO_PREFIX
+#define OAHT_CUCKOO_PREFIX cuckoo_fn
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32((unsigned)(key), seed)
+#include "oaht_cuckoo.h"
+#undef OAHT_HASH_FN
+
+/* A hashtable type with counters */
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX stats
+#define OAHT_STATS
+#include "oaht.h"
+#undef OAHT_STATS
+
+/* Hashtable types with snapshots, using pages of 16 slots */
+#define OAHT_SNAPSHOT
+#define OAHT_SNAPSHOT_PAGE 16
+#undef OAHT_HASH
+#define OAHT_HASH(x) ((int)((unsigned)(x) * 2654435761u))
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX snap
+#include "oaht.h"
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX snap_rh
+#define OAHT_BACKSHIFT_DELETE
+#define OAHT_ROBIN_HOOD
+#include "oaht.h"
+#undef OAHT_ROBIN_HOOD
+#undef OAHT_BACKSHIFT_DELETE
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#undef OAHT_VALUE_T
+#define OAHT_PREFIX snap_soa
+#define OAHT_VALUE_T double
+#define OAHT_SOA
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+#undef OAHT_SOA
+#undef OAHT_VALUE_T
+#define OAHT_VALUE_T int
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX snap_small
+#define OAHT_SMALL_SIZE 16
+#include "oaht.h"
+#undef OAHT_SMALL_SIZE
+#undef OAHT_SNAPSHOT
+#undef OAHT_SNAPSHOT_PAGE
+#undef OAHT_HASH
+
+/* Compact sets of seeded keys, storing only 7 bits of the hashes */
+#define OAHT_NO_VALUE
+#define OAHT_NO_STORE_HASH
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32((unsigned)(key), seed)
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX fpset
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX fpset_rh
+#define OAHT_BACKSHIFT_DELETE
+#define OAHT_ROBIN_HOOD
+#include "oaht.h"
+#undef OAHT_ROBIN_HOOD
+#undef OAHT_BACKSHIFT_DELETE
+#undef OAHT_HASH_FN
+#undef OAHT_NO_STORE_HASH
+#undef OAHT_NO_VALUE
+
+/* Sets for the set operations, seeded and small or resized incrementally */
+#define OAHT_NO_VALUE
+#define OAHT_PARALLEL_RESIZE
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX algset
+#define OAHT_HASH_FN(key, seed) oaht_hash_u32((unsigned)(key), seed)
+#define OAHT_SMALL_SIZE 8
+#define OAHT_CONTROL_BYTES
+#include "oaht.h"
+#undef OAHT_CONTROL_BYTES
+#undef OAHT_SMALL_SIZE
+#undef OAHT_HASH_FN
+
+#undef OAHT_H
+#undef OAHT_PREFIX
+#define OAHT_PREFIX algset_inc
+#define OAHT_INCREMENTAL_RESIZE
+#include "oaht.h"
+#undef OAHT_INCREMENTAL_RESIZE
+#undef OAHT_PARALLEL_RESIZE
+#undef OAHT_NO_VALUE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
+#include <pthread.h>
 
 /** helper; creates a small table with 2 elements */
 static struct oaht * create_5_42_400_9(void) {
@@ -79,10 +383,1412 @@ void large_table_test(void) {
 	oaht_destroy(ht);
 }
 
+/* Entries are found in both tables while an incremental resize is ongoing */
+void incremental_resize_test(void) {
+	int i, k, v, cnt = 0, n = 10000;
+	unsigned int pos;
+	struct inc * ht = inc_create();
+	for (i = 1; i <= n; i++) {
+		ht = inc_set(ht, i, i);
+		if (i % 3 == 0)
+			ht = inc_delete(ht, i / 3);
+		assert(inc_get(ht, i, -1) == i);
+	}
+	assert((int)inc_len(ht) == n - n / 3);
+	for (i = 1; i <= n; i++)
+		assert(inc_get(ht, i, -1) == (i <= n / 3 ? -1 : i));
+	for (pos = 0; (pos = inc_iter(ht, pos, &k, &v));)
+		cnt++;
+	assert(cnt == n - n / 3);
+	inc_destroy(ht);
+}
+
+/* Batched lookups */
+void get_many_test(void) {
+	int keys[40], values[40], found[40], i;
+	struct oaht * ht = create_5_42_400_9();
+	for (i = 0; i < 40; i++)
+		keys[i] = i % 2 ? 5 : 400 + i;
+	assert(oaht_get_many(ht, keys, 40, values, -1) == 21);
+	assert(oaht_contains_many(ht, keys, 40, found) == 21);
+	for (i = 0; i < 40; i++) {
+		assert(values[i] == (i % 2 ? 42 : i == 0 ? 9 : -1));
+		assert(found[i] == (i % 2 || i == 0));
+	}
+	oaht_destroy(ht);
+}
+
+/* Batched inserts resize once and report which keys were new */
+void set_many_test(void) {
+	int keys[300], values[300], inserted[300], i;
+	struct oaht * ht = create_5_42_400_9();
+	struct inc * inc = inc_create();
+	for (i = 0; i < 300; i++) {
+		keys[i] = i % 3 ? 1000 + i : 5;
+		values[i] = i;
+	}
+	ht = oaht_set_many(ht, keys, values, 300, inserted);
+	/* sized once for 2 + 300 entries, not grown step by step */
+	assert(ht->mask == 511);
+	assert(oaht_len(ht) == 202);
+	assert(oaht_get(ht, 5, -1) == 297);
+	assert(oaht_get(ht, 400, -1) == 9);
+	for (i = 0; i < 300; i++) {
+		assert(inserted[i] == (i % 3 != 0));
+		if (i % 3)
+			assert(oaht_get(ht, keys[i], -1) == i);
+	}
+	ht = oaht_set_many(ht, keys, values, 300, NULL);
+	assert(oaht_len(ht) == 202);
+	/* in the middle of an incremental resize */
+	for (i = 0; i < 100; i++)
+		inc = inc_set(inc, keys[i], i);
+	inc = inc_set_many(inc, keys, values, 300, inserted);
+	assert(inc_len(inc) == 201);
+	for (i = 0; i < 300; i++) {
+		assert(inserted[i] == (i >= 100 && i % 3 != 0));
+		assert(inc_get(inc, keys[i], -1) == (i % 3 ? i : 297));
+	}
+	inc_destroy(inc);
+	oaht_destroy(ht);
+}
+
+/* Reserved space is filled without resizing */
+void reserve_test(void) {
+	int i;
+	unsigned int mask;
+	struct oaht * ht = create_5_42_400_9();
+	struct dense * d = dense_create();
+	ht = oaht_reserve(ht, 1000);
+	mask = ht->mask;
+	assert(mask == 2047);
+	for (i = 1; i <= 1000 - 2; i++) {
+		ht = oaht_set(ht, 1000 + i, i);
+		assert(ht->mask == mask);
+	}
+	/* reserving less than the current size does nothing */
+	ht = oaht_reserve(ht, 10);
+	assert(ht->mask == mask && oaht_len(ht) == 1000);
+	/* up to 7/8 of the slots are used before growing to 2 * used */
+	for (i = 1; i <= 1000; i++) {
+		mask = d->mask;
+		d = dense_set(d, i, i);
+		if (d->mask != mask)
+			assert(i * 8 >= (int)(mask + 1) * 7 && d->mask == 2 * mask + 1);
+	}
+	assert(d->mask == 2047 && dense_len(d) == 1000);
+	for (i = 1; i <= 1000; i++)
+		assert(dense_get(d, i, -1) == i);
+	dense_destroy(d);
+	oaht_destroy(ht);
+}
+
+/* Growing within the same memory, with clusters wrapping around the end */
+void grow_in_place_test(void) {
+	int i, j, n = 5000;
+	int *keys = malloc(n * sizeof(int));
+	struct oaht * ht = oaht_create();
+	for (i = 0; i < n; i++) {
+		unsigned int mask = ht->mask;
+		/* the initial probe is in the last slots of the current table */
+		keys[i] = (int)(mask - i % 4 + 5 + (i + 1) * (mask + 1));
+		ht = oaht_set(ht, keys[i], i);
+		if (ht->mask != mask)
+			for (j = 0; j <= i; j++)
+				assert(oaht_get(ht, keys[j], -1) == j);
+	}
+	assert(oaht_len(ht) == (unsigned)n);
+	oaht_destroy(ht);
+	free(keys);
+}
+
+/* Deleted slots are reclaimed and the table shrinks when mostly empty */
+void compact_test(void) {
+	int i, n = 10000;
+	struct oaht * ht = oaht_create();
+	for (i = 1; i <= n; i++)
+		ht = oaht_set(ht, i, i);
+	for (i = 1; i <= n - 10; i++)
+		ht = oaht_delete(ht, i);
+	assert(oaht_len(ht) == 10);
+	assert(ht->mask + 1 <= 64);
+	for (i = n - 9; i <= n; i++)
+		assert(oaht_get(ht, i, -1) == i);
+	/* churn with a constant number of entries */
+	for (i = n + 1; i <= 10 * n; i++) {
+		ht = oaht_set(ht, i, i);
+		ht = oaht_delete(ht, i - 10);
+		assert(ht->fill - ht->used <= (ht->mask + 1) / 4);
+	}
+	for (i = 10 * n - 9; i <= 10 * n; i++)
+		assert(oaht_get(ht, i, -1) == i);
+	ht = oaht_compact(ht);
+	assert(ht->fill == ht->used);
+	for (i = 10 * n - 9; i <= 10 * n; i++)
+		assert(oaht_get(ht, i, -1) == i);
+	oaht_destroy(ht);
+}
+
+/* No DELETED slots are left by backshift deletion */
+void backshift_delete_test(void) {
+	int i, n = 5000;
+	unsigned int pos;
+	struct bs * ht = bs_create();
+	/* -1 is the default deleted key, but it's not special here */
+	ht = bs_set(ht, -1, 7);
+	for (i = 1; i <= n; i++)
+		ht = bs_set(ht, i * 16, i);
+	for (i = 1; i <= n; i += 2)
+		ht = bs_delete(ht, i * 16);
+	assert(bs_len(ht) == 1 + (unsigned)n / 2);
+	assert(ht->fill == ht->used);
+	for (pos = 0; pos <= ht->mask; pos++)
+		assert(ht->els[pos].key != -1 || ht->els[pos].value == 7);
+	for (i = 1; i <= n; i++)
+		assert(bs_get(ht, i * 16, -1) == (i % 2 ? -1 : i));
+	assert(bs_get(ht, -1, 0) == 7);
+	bs_destroy(ht);
+}
+
+/* Entries moved back into migrated slots are migrated too */
+void incremental_backshift_test(void) {
+	int i, n = 342;
+	struct incbs * ht = incbs_create();
+	for (i = 1; i <= n; i++)
+		ht = incbs_set(ht, i, i);
+	ht = incbs_reserve(ht, 5000);
+	assert((int)incbs_len(ht) == n);
+	for (i = 1; i <= n; i++)
+		assert(incbs_get(ht, i, -1) == i);
+	for (i = 1; i <= 2 * n; i++) {
+		ht = incbs_set(ht, n + i, i);
+		if (i <= n && i % 2)
+			ht = incbs_delete(ht, i);
+	}
+	ht = incbs_compact(ht);
+	assert(ht->old == NULL);
+	assert((int)incbs_len(ht) == n / 2 + 2 * n);
+	for (i = 1; i <= 3 * n; i++)
+		assert(incbs_get(ht, i, -1) == (i > n ? i - n :
+		                                i % 2 ? -1 : i));
+	incbs_destroy(ht);
+}
+
+/* The probe distance never grows by more than one from a slot to the next */
+static void assert_robin_hood_order(struct rh *ht) {
+	unsigned int pos, prev = 0, dist;
+	for (pos = 0; pos <= ht->mask; pos++) {
+		if (ht->els[pos].key == 0) {
+			prev = 0;
+			continue;
+		}
+		dist = rh_probe_distance(ht, &ht->els[pos], pos);
+		assert(pos == 0 || dist <= prev + 1);
+		prev = dist;
+	}
+}
+
+void robin_hood_test(void) {
+	int i, n = 5000;
+	struct rh * ht = rh_create();
+	for (i = 1; i <= n; i++)
+		ht = rh_set(ht, i * 8, i);
+	assert_robin_hood_order(ht);
+	for (i = 1; i <= n; i += 3)
+		ht = rh_delete(ht, i * 8);
+	assert_robin_hood_order(ht);
+	for (i = 1; i <= n; i++) {
+		assert(rh_get(ht, i * 8, -1) == (i % 3 == 1 ? -1 : i));
+		assert(rh_get(ht, i * 8 + 1, -1) == -1);
+	}
+	rh_destroy(ht);
+}
+
+/* Lookups via control bytes, in small tables and with deleted slots */
+void control_bytes_test(void) {
+	int i, n = 5000;
+	struct cb * ht = cb_create();
+	ht = cb_set(ht, 3, 3);
+	ht = cb_set(ht, 11, 11); /* same initial probe as 3 */
+	assert(cb_get(ht, 3, -1) == 3);
+	assert(cb_get(ht, 11, -1) == 11);
+	assert(cb_get(ht, 19, -1) == -1);
+	ht = cb_delete(ht, 3);
+	assert(cb_get(ht, 11, -1) == 11);
+	for (i = 1; i <= n; i++)
+		ht = cb_set(ht, i * 32, i);
+	for (i = 1; i <= n; i += 2)
+		ht = cb_delete(ht, i * 32);
+	for (i = 1; i <= n; i++)
+		ht = cb_set(ht, i * 32 + 1, i);
+	for (i = 1; i <= n; i++) {
+		assert(cb_get(ht, i * 32, -1) == (i % 2 ? -1 : i));
+		assert(cb_get(ht, i * 32 + 1, -1) == i);
+	}
+	assert(cb_len(ht) == 1 + (unsigned)n / 2 + (unsigned)n);
+	cb_destroy(ht);
+}
+
+/* Values stored apart from the keys follow them through resizes */
+void soa_test(void) {
+	int i, n = 5000;
+	int k;
+	double v, sum = 0;
+	unsigned int pos = 0;
+	struct soa * ht = soa_create();
+	for (i = 1; i <= n; i++)
+		ht = soa_set(ht, i, i + 0.5);
+	for (i = 1; i <= n; i += 2)
+		ht = soa_delete(ht, i);
+	for (i = 1; i <= n; i++)
+		assert(soa_get(ht, i, -1) == (i % 2 ? -1 : i + 0.5));
+	while ((pos = soa_iter(ht, pos, &k, &v))) {
+		assert(v == k + 0.5);
+		sum += v;
+	}
+	assert(sum == (n / 2) * (n / 2 + 1) + 0.5 * (n / 2));
+	/* the values are after the entries, within the same allocation */
+	assert((char *)&soa_values(ht)[ht->mask + 1] ==
+	       (char *)ht + soa_sizeof(ht->mask));
+	soa_destroy(ht);
+}
+
+/* Tables replaced while a reader uses them are free'd after it's done */
+void concurrent_read_test(void) {
+	int i, n = 1000;
+	struct cr_rcu r;
+	struct cr * ht = cr_create();
+	struct cr * t0, * t1;
+	cr_rcu_init(&r, ht);
+	ht = cr_set(ht, 5, 42);
+	cr_publish(&r, ht);
+	t0 = cr_read_lock(&r, 0);
+	assert(t0 == ht && cr_get(t0, 5, -1) == 42);
+	for (i = 1; i <= n; i++)
+		ht = cr_set(ht, 1000 + i, i);
+	cr_publish(&r, ht);
+	/* reader 0 still has the old table */
+	assert(r.table == ht && r.retired != NULL);
+	assert(cr_get(t0, 5, -1) == 42 && cr_get(t0, 1000 + n, -1) == -1);
+	t1 = cr_read_lock(&r, 1);
+	assert(t1 == ht && cr_get(t1, 1000 + n, -1) == n);
+	cr_read_unlock(&r, 0);
+	cr_reclaim(&r);
+	assert(r.retired == NULL);
+	/* deleted slots are not reused, but removed by copying the table */
+	for (i = 1; i <= n; i++) {
+		ht = cr_delete(ht, 1000 + i);
+		ht = cr_set(ht, 1000 + i, -i);
+	}
+	cr_publish(&r, ht);
+	assert(r.retired != NULL && cr_get(t1, 1000 + n, 0) != 0);
+	cr_read_unlock(&r, 1);
+	ht = cr_set(ht, 6, 6);
+	cr_publish(&r, ht);
+	assert(r.retired == NULL);
+	for (i = 1; i <= n; i++)
+		assert(cr_get(ht, 1000 + i, 0) == -i);
+	cr_rcu_destroy(&r);
+}
+
+/* Threads inserting into the same sharded table */
+struct sharded_arg {
+	struct sharded * s;
+	int t;
+};
+
+static void *sharded_writer(void *arg) {
+	struct sharded_arg * a = arg;
+	int i;
+	for (i = 1; i <= 10000; i++) {
+		sharded_set(a->s, a->t * 100000 + i, i);
+		if (i % 2)
+			sharded_delete(a->s, a->t * 100000 + i);
+	}
+	return NULL;
+}
+
+/* Counts the entries visited by a scan of the sharded table */
+static void sharded_scan_count(void *arg, const int *key, int *value) {
+	assert(*key % 100000 == *value);
+	++*(int *)arg;
+}
+
+void sharded_test(void) {
+	struct sharded * s = sharded_create();
+	struct sharded_cursor c = {0, 0}, sc = {0, 0};
+	struct sharded_arg args[4];
+	pthread_t threads[4];
+	int i, t, k, v, n = 0, used = 0;
+	for (t = 0; t < 4; t++) {
+		args[t].s = s;
+		args[t].t = t;
+		pthread_create(&threads[t], NULL, sharded_writer, &args[t]);
+	}
+	for (t = 0; t < 4; t++)
+		pthread_join(threads[t], NULL);
+	assert(sharded_len(s) == 4 * 5000);
+	for (t = 0; t < 4; t++)
+		for (i = 1; i <= 10000; i++)
+			assert(sharded_get(s, t * 100000 + i, -1) == (i % 2 ? -1 : i));
+	while (sharded_iter(s, &c, &k, &v)) {
+		assert(k % 100000 == v);
+		n++;
+	}
+	assert(n == 4 * 5000);
+	n = 0;
+	while (sharded_scan(s, &sc, sharded_scan_count, &n))
+		;
+	assert(n == 4 * 5000);
+	/* consecutive keys hashed by the identity are spread over the shards */
+	for (i = 0; i < 1 << OAHT_SHARD_BITS; i++)
+		used += sh_len(s->shards[i].table) > 0;
+	assert(used == 1 << OAHT_SHARD_BITS);
+	sharded_destroy(s);
+}
+
+/* Rehashing using several threads, including the entries crossing parts */
+void resize_parallel_test(void) {
+	int i, n = 100000, cluster[100];
+	struct par * ht = par_create();
+	for (i = 1; i <= n; i++)
+		ht = par_set(ht, i, i);
+	/* with 2 parts, a cluster across the middle of the new table */
+	for (i = 0; i < 100; i++) {
+		cluster[i] = (int)(2 * (ht->mask + 1)) - 50 + i + 5;
+		ht = par_set(ht, cluster[i], -i);
+	}
+	ht = par_resize_parallel(ht, 4 * (ht->mask + 1), 3);
+	assert(par_len(ht) == (unsigned)n + 100);
+	for (i = 1; i <= n; i++)
+		assert(par_get(ht, i, 0) == i);
+	for (i = 0; i < 100; i++)
+		assert(par_get(ht, cluster[i], 1) == -i);
+	for (i = 1; i <= n; i += 2)
+		ht = par_delete(ht, i);
+	ht = par_resize_parallel(ht, 0, 8);
+	for (i = 1; i <= n; i++)
+		assert(par_get(ht, i, 0) == (i % 2 ? 0 : i));
+	assert(par_len(ht) == (unsigned)n / 2 + 100);
+	par_destroy(ht);
+}
+
+/* Keys aren't hashed until the table grows beyond 16 slots */
+void small_test(void) {
+	int i, k, v, n;
+	unsigned int pos = 0;
+	struct small *ht = small_create();
+	for (i = 1; i <= 15; i++)
+		ht = small_set(ht, i, 10 * i);
+	assert(ht->mask == 15);
+	assert(small_get(ht, 7, 0) == 70 && small_get(ht, 99, 0) == 0);
+	ht = small_delete(ht, 3);
+	assert(!small_contains(ht, 3) && small_len(ht) == 14);
+	for (n = 0; (pos = small_iter(ht, pos, &k, &v)); n++)
+		assert(v == 10 * k);
+	assert(n == 14);
+	assert(small_hashes == 0);
+	/* the 16th key doesn't fit with an EMPTY slot */
+	ht = small_set(ht, 3, 30);
+	ht = small_set(ht, 16, 160);
+	assert(ht->mask > 15 && small_hashes > 0);
+	for (i = 1; i <= 16; i++)
+		assert(small_get(ht, i, 0) == 10 * i);
+	/* and shrinks back to a small table */
+	for (i = 1; i <= 14; i++)
+		ht = small_delete(ht, i);
+	ht = small_compact(ht);
+	assert(ht->mask <= 15);
+	small_hashes = 0;
+	assert(small_get(ht, 15, 0) == 150 && small_get(ht, 16, 0) == 160);
+	assert(small_get(ht, 1, 0) == 0 && small_hashes == 0);
+	small_destroy(ht);
+}
+
+/* Returns the keys 1, 2, ... up to the limit, with their squares */
+struct build_arg {
+	int i, limit;
+};
+
+static int build_next(void *arg, int *key, int *value) {
+	struct build_arg *b = (struct build_arg *)arg;
+	if (b->i >= b->limit)
+		return 0;
+	b->i++;
+	*key = map_to_some_odd_number(b->i);
+	*value = b->i * 2;
+	return 1;
+}
+
+void build_from_test(void) {
+	struct build_arg arg = {0, 100000};
+	struct oaht *ht = oaht_build_from(build_next, &arg, 100000);
+	int i;
+	assert(oaht_len(ht) == 100000);
+	for (i = 1; i <= 100000; i++)
+		assert(oaht_get(ht, map_to_some_odd_number(i), 0) == i * 2);
+	assert(!oaht_contains(ht, 2));
+	ht = oaht_set(ht, 2, 2);
+	assert(oaht_get(ht, 2, 0) == 2);
+	oaht_destroy(ht);
+	/* fewer entries than n */
+	arg.i = 0;
+	arg.limit = 10;
+	ht = oaht_build_from(build_next, &arg, 1000);
+	assert(oaht_len(ht) == 10);
+	assert(oaht_get(ht, map_to_some_odd_number(10), 0) == 20);
+	oaht_destroy(ht);
+}
+
+/* A saved table is mapped with its entries, and only by the same type */
+void mmap_test(void) {
+	char path[] = "/tmp/oaht_test_XXXXXX";
+	int i, k, v, n = 0, fd = mkstemp(path);
+	unsigned int pos = 0;
+	struct mapped *ht = mapped_create(), *m;
+	assert(fd >= 0);
+	for (i = 1; i <= 1000; i++)
+		ht = mapped_set(ht, i, i * i);
+	for (i = 1; i <= 1000; i += 3)
+		ht = mapped_delete(ht, i);
+	assert(mapped_save(ht, fd) == 0);
+	close(fd);
+	m = mapped_open_mmap(path);
+	assert(m != NULL && mapped_len(m) == mapped_len(ht));
+	for (i = 1; i <= 1001; i++)
+		assert(mapped_get(m, i, -1) == mapped_get(ht, i, -1));
+	while ((pos = mapped_iter(m, pos, &k, &v))) {
+		assert(v == k * k && k % 3 != 1);
+		n++;
+	}
+	assert(n == (int)mapped_len(ht));
+	mapped_close_mmap(m);
+	assert(mapped_dbl_open_mmap(path) == NULL && errno == EINVAL);
+	unlink(path);
+	assert(mapped_open_mmap(path) == NULL && errno == ENOENT);
+	mapped_destroy(ht);
+}
+
+/* Small tables reuse the freed blocks and large ones use malloc */
+void pool_test(void) {
+	struct pooled *tables[100], *big;
+	void *first;
+	int i, j;
+	for (i = 0; i < 100; i++) {
+		tables[i] = pooled_create();
+		for (j = 1; j <= i; j++)
+			tables[i] = pooled_set(tables[i], j, j);
+	}
+	for (i = 0; i < 100; i++) {
+		for (j = 1; j <= i; j++)
+			assert(pooled_get(tables[i], j, 0) == j);
+		assert(pooled_len(tables[i]) == (unsigned)i);
+	}
+	first = tables[0];
+	pooled_destroy(tables[0]);
+	tables[0] = pooled_create();
+	assert((void *)tables[0] == first);
+	for (i = 0; i < 100; i++)
+		pooled_destroy(tables[i]);
+	big = pooled_create();
+	for (i = 1; i <= 10000; i++)
+		big = pooled_set(big, i, i);
+	for (i = 1; i <= 10000; i += 2)
+		big = pooled_delete(big, i);
+	for (i = 1; i <= 10000; i++)
+		assert(pooled_get(big, i, 0) == (i % 2 ? 0 : i));
+	pooled_destroy(big);
+	oaht_pool_clear();
+}
+
+/* Iteration over entry pointers, skipping the empty slots of a sparse table */
+void next_test(void) {
+	int i, n = 10000, cnt = 0, sum = 0;
+	unsigned int pos = 0;
+	struct cb_entry *e;
+	struct cb * ht = cb_create();
+	for (i = 1; i <= n; i++)
+		ht = cb_set(ht, i, i);
+	for (i = 1; i <= n; i++)
+		if (i % 100)
+			ht = cb_delete(ht, i);
+	while ((e = cb_next(ht, &pos))) {
+		assert(*cb_entry_value(ht, e) == e->key);
+		assert(e->key % 100 == 0);
+		cnt++;
+		sum += e->key;
+	}
+	assert(cnt == n / 100);
+	assert(sum == 100 * (n / 100) * (n / 100 + 1) / 2);
+	cb_destroy(ht);
+}
+
+/* Iteration over a set, where there are no values */
+void keyset_iter_test(void) {
+	int i, k, cnt = 0, sum = 0;
+	unsigned int pos = 0;
+	struct keyset * ht = keyset_create();
+	for (i = 1; i <= 100; i++)
+		ht = keyset_add(ht, i);
+	while ((pos = keyset_iter(ht, pos, &k, NULL))) {
+		cnt++;
+		sum += k;
+	}
+	assert(cnt == 100);
+	assert(sum == 5050);
+	keyset_destroy(ht);
+}
+
+/* The number of times each key has been visited by a scan */
+static int scan_seen[60000];
+
+static void scan_count(void *arg, const int *key, int *value) {
+	assert(*key == *value);
+	(void)arg;
+	scan_seen[*key]++;
+}
+
+static void keyset_scan_count(void *arg, const int *key) {
+	(void)arg;
+	scan_seen[*key]++;
+}
+
+/*
+ * Scans a table of the keys 1 to 1000 while other keys are inserted and
+ * deleted, making it grow and shrink. Each of the keys 1 to 1000 must be
+ * visited at least once.
+ */
+#define SCAN_TEST(prefix)                                                     \
+	void prefix##_scan_test(void) {                                       \
+		int i, steps = 0;                                             \
+		unsigned int cursor = 0;                                      \
+		struct prefix * ht = prefix##_create();                       \
+		memset(scan_seen, 0, sizeof(scan_seen));                      \
+		for (i = 1; i <= 1000; i++)                                   \
+			ht = prefix##_set(ht, i, i);                          \
+		do {                                                          \
+			cursor = prefix##_scan(ht, cursor, scan_count, NULL); \
+			steps++;                                              \
+			assert(1000 + steps < 60000);                         \
+			if (steps <= 3000)                                    \
+				ht = prefix##_set(ht, 1000 + steps,           \
+				                  1000 + steps);              \
+			else                                                  \
+				ht = prefix##_delete(ht, steps - 2000);       \
+		} while (cursor);                                             \
+		for (i = 1; i <= 1000; i++)                                   \
+			assert(scan_seen[i] >= 1);                            \
+		prefix##_destroy(ht);                                         \
+	}
+
+SCAN_TEST(oaht)
+SCAN_TEST(inc)
+SCAN_TEST(rh)
+SCAN_TEST(cb)
+SCAN_TEST(small)
+
+/* A complete scan without modifications visits a small table's keys once */
+void scan_test(void) {
+	int i;
+	unsigned int cursor = 0;
+	struct small * st = small_create();
+	struct keyset * ks = keyset_create();
+	oaht_scan_test();
+	inc_scan_test();
+	rh_scan_test();
+	cb_scan_test();
+	small_scan_test();
+	memset(scan_seen, 0, sizeof(scan_seen));
+	for (i = 1; i <= 5; i++)
+		st = small_set(st, i, i);
+	assert(small_scan(st, 0, scan_count, NULL) == 0);
+	for (i = 1; i <= 5; i++)
+		assert(scan_seen[i] == 1);
+	small_destroy(st);
+	memset(scan_seen, 0, sizeof(scan_seen));
+	for (i = 1; i <= 1000; i++)
+		ks = keyset_add(ks, i);
+	do
+		cursor = keyset_scan(ks, cursor, keyset_scan_count, NULL);
+	while (cursor);
+	for (i = 1; i <= 1000; i++)
+		assert(scan_seen[i] == 1);
+	keyset_destroy(ks);
+}
+
+/* The seeded hash functions, and tables using them */
+void hash_fn_test(void) {
+	const char *text = "The quick brown fox jumps over the lazy dog";
+	unsigned long long h[44];
+	int i, j, n = 20000, low = 0;
+	struct seeded * a = seeded_create();
+	struct seeded * b = seeded_create();
+	/* all lengths and all bytes matter */
+	for (i = 0; i <= 43; i++) {
+		h[i] = oaht_hash_bytes(text, i, 1);
+		assert(h[i] == oaht_hash_bytes(text, i, 1));
+		assert(h[i] != oaht_hash_bytes(text, i, 2));
+		for (j = 0; j < i; j++)
+			assert(h[i] != h[j]);
+	}
+	assert(oaht_hash_str(text, 7) == oaht_hash_bytes(text, 43, 7));
+	assert(oaht_hash_bytes("abcdefghijklmnopq", 17, 0) !=
+	       oaht_hash_bytes("abcdefghijklmnopr", 17, 0));
+	/* multiples of 4096 are spread over the low bits */
+	for (i = 1; i <= 1024; i++)
+		low |= 1 << (oaht_hash_u64((unsigned long long)i << 12, 0) & 15);
+	assert(low == 0xffff);
+	#ifdef OAHT_HASH_HAVE_CRC32C
+	assert(oaht_hash_crc32c_u64(4096, 0) != oaht_hash_crc32c_u64(8192, 0));
+	#endif
+	/* the tables have different seeds, which are kept when they grow */
+	assert(a->seed != b->seed);
+	for (i = 1; i <= n; i++) {
+		a = seeded_set(a, i * 4096, i);
+		b = seeded_set(b, i * 4096, i);
+	}
+	assert(a->seed != b->seed);
+	for (i = 1; i <= n; i++) {
+		assert(seeded_get(a, i * 4096, 0) == i);
+		assert(seeded_get(b, i * 4096, 0) == i);
+	}
+	assert(seeded_get(a, 4095, 0) == 0);
+	seeded_destroy(a);
+	seeded_destroy(b);
+}
+
+/* Counting with upsert, while deleting some of the keys */
+#define UPSERT_TEST(prefix, value_t)                                          \
+	void prefix##_upsert_test(void) {                                     \
+		int i, key, inserted;                                         \
+		value_t *v;                                                   \
+		struct prefix * ht = prefix##_create();                       \
+		for (i = 0; i < 30000; i++) {                                 \
+			key = 1 + i * 7919 % 3000;                            \
+			v = prefix##_upsert(&ht, key, &inserted);             \
+			assert(inserted == (*v == 0));                        \
+			assert(inserted == (i < 3000));                       \
+			(*v)++;                                               \
+		}                                                             \
+		assert(prefix##_len(ht) == 3000);                             \
+		for (key = 1; key <= 3000; key++) {                           \
+			assert(prefix##_get(ht, key, 0) == 10);               \
+			assert(*prefix##_get_ptr(ht, key) == 10);             \
+		}                                                             \
+		assert(prefix##_get_ptr(ht, 3001) == NULL);                   \
+		for (key = 1; key <= 3000; key += 2)                          \
+			ht = prefix##_delete(ht, key);                        \
+		for (key = 1; key <= 6000; key++) {                           \
+			v = prefix##_upsert(&ht, key, NULL);                  \
+			assert(*v == (key <= 3000 && key % 2 == 0 ? 10 : 0)); \
+			*v = -key;                                            \
+		}                                                             \
+		for (key = 1; key <= 6000; key++)                             \
+			assert(prefix##_get(ht, key, 0) == -key);             \
+		prefix##_destroy(ht);                                         \
+	}
+
+UPSERT_TEST(oaht, int)
+UPSERT_TEST(inc, int)
+UPSERT_TEST(bs, int)
+UPSERT_TEST(rh, int)
+UPSERT_TEST(cb, int)
+UPSERT_TEST(soa, double)
+UPSERT_TEST(small, int)
+
+void upsert_test(void) {
+	oaht_upsert_test();
+	inc_upsert_test();
+	bs_upsert_test();
+	rh_upsert_test();
+	cb_upsert_test();
+	soa_upsert_test();
+	small_upsert_test();
+}
+
+/*
+ * The functions given hashes, computed once for two tables, which must then
+ * have the same seed if they have one
+ */
+#define HASH_GIVEN_TEST(prefix, same_seed)                                    \
+	void prefix##_hash_given_test(void) {                                 \
+		int key;                                                      \
+		struct prefix * a = prefix##_create();                        \
+		struct prefix * b = prefix##_create();                        \
+		same_seed;                                                    \
+		for (key = 1; key <= 2000; key++) {                           \
+			OAHT_HASH_T h = prefix##_hash(a, key);                \
+			a = prefix##_set_h(a, key, h, key);                   \
+			(*prefix##_upsert_h(&b, key, h, NULL)) += key;        \
+		}                                                             \
+		for (key = 1; key <= 2000; key += 2) {                        \
+			OAHT_HASH_T h = prefix##_hash(a, key);                \
+			a = prefix##_delete_h(a, key, h);                     \
+			b = prefix##_delete_h(b, key, h);                     \
+		}                                                             \
+		for (key = 1; key <= 2001; key++) {                           \
+			OAHT_HASH_T h = prefix##_hash(a, key);                \
+			int v = key % 2 || key > 2000 ? 0 : key;              \
+			assert(prefix##_get_h(a, key, h, 0) == v);            \
+			assert(prefix##_get(b, key, 0) == v);                 \
+			assert(prefix##_contains_h(b, key, h) == (v != 0));   \
+			assert(v ? *prefix##_get_ptr_h(a, key, h) == v        \
+			         : !prefix##_get_ptr_h(a, key, h));           \
+		}                                                             \
+		prefix##_destroy(a);                                          \
+		prefix##_destroy(b);                                          \
+	}
+
+HASH_GIVEN_TEST(oaht, (void)0)
+HASH_GIVEN_TEST(inc, (void)0)
+HASH_GIVEN_TEST(rh, (void)0)
+HASH_GIVEN_TEST(small, (void)0)
+HASH_GIVEN_TEST(seeded, b->seed = a->seed)
+
+void hash_given_test(void) {
+	int key;
+	struct keyset * ks = keyset_create();
+	oaht_hash_given_test();
+	inc_hash_given_test();
+	rh_hash_given_test();
+	small_hash_given_test();
+	seeded_hash_given_test();
+	for (key = 1; key <= 100; key++)
+		ks = keyset_add_h(ks, key, keyset_hash(ks, key));
+	for (key = 1; key <= 101; key++)
+		assert(keyset_contains(ks, key) == (key <= 100));
+	keyset_destroy(ks);
+}
+
+/* The huge page allocator, and a table growing into mapped blocks and back */
+void huge_test(void) {
+	struct huge * ht = huge_create();
+	char *p;
+	int i;
+	p = oaht_huge_alloc(100);
+	strcpy(p, "small");
+	p = oaht_huge_realloc(p, OAHT_HUGE_MIN_SIZE, 100);
+	#ifndef OAHT_HUGE_NO_MMAP
+	assert(((size_t)p & (OAHT_HUGE_PAGE_SIZE - 1)) == 0);
+	#endif
+	assert(strcmp(p, "small") == 0);
+	p[OAHT_HUGE_MIN_SIZE - 1] = 1;
+	#ifndef OAHT_HUGE_NO_MMAP
+	assert(oaht_huge_realloc(p, OAHT_HUGE_MIN_SIZE + 1,
+	                         OAHT_HUGE_MIN_SIZE) == p);
+	#endif
+	p = oaht_huge_realloc(p, 3 * OAHT_HUGE_PAGE_SIZE, OAHT_HUGE_MIN_SIZE + 1);
+	assert(p[OAHT_HUGE_MIN_SIZE - 1] == 1 && strcmp(p, "small") == 0);
+	p[3 * OAHT_HUGE_PAGE_SIZE - 1] = 1;
+	p = oaht_huge_realloc(p, 10, 3 * OAHT_HUGE_PAGE_SIZE);
+	assert(strcmp(p, "small") == 0);
+	oaht_huge_free(p, 10);
+	for (i = 1; i <= 100000; i++)
+		ht = huge_set(ht, i, i);
+	assert(huge_sizeof(ht->mask) >= OAHT_HUGE_MIN_SIZE);
+	for (i = 1; i <= 100000; i++)
+		assert(huge_get(ht, i, 0) == i);
+	for (i = 1; i <= 99990; i++)
+		ht = huge_delete(ht, i);
+	assert(huge_sizeof(ht->mask) < OAHT_HUGE_MIN_SIZE);
+	for (i = 1; i <= 100000; i++)
+		assert(huge_get(ht, i, 0) == (i > 99990 ? i : 0));
+	huge_destroy(ht);
+}
+
+/* The counters and the statistics of the slots */
+void stats_test(void) {
+	struct oaht_stats st;
+	struct stats_stats ss;
+	struct oaht * a = oaht_create();
+	struct stats * b = stats_create();
+	unsigned long long hits;
+	int i, n = 20;
+	/* keys whose initial probes are all the same slot form one cluster */
+	for (i = 1; i <= n; i++)
+		a = oaht_set(a, i * 4096 + 5, i);
+	assert(a->mask < 4096);
+	oaht_stats(a, &st);
+	assert(st.size == a->mask + 1);
+	assert(st.used == (OAHT_SIZE_T)n && st.deleted == 0);
+	assert(st.load == st.fill && st.load == (double)n / st.size);
+	assert(st.max_distance == (OAHT_SIZE_T)n - 1);
+	assert(st.mean_distance == (n - 1) / 2.0);
+	assert(st.distances[0] == 1 && st.distances[1] == 1);
+	assert(st.distances[OAHT_STATS_DISTANCES - 1] ==
+	       (OAHT_SIZE_T)n - OAHT_STATS_DISTANCES + 1);
+	assert(st.clusters == 1 && st.max_cluster == (OAHT_SIZE_T)n);
+	a = oaht_delete(a, 4096 + 5);
+	oaht_stats(a, &st);
+	assert(st.used == (OAHT_SIZE_T)n - 1 && st.deleted == 1);
+	assert(st.fill > st.load);
+	assert(st.clusters == 1 && st.max_cluster == (OAHT_SIZE_T)n);
+	oaht_destroy(a);
+	/* the counters are kept when the table grows */
+	for (i = 1; i <= 1000; i++)
+		b = stats_set(b, i, i);
+	stats_stats(b, &ss);
+	assert(ss.used == 1000);
+	assert(ss.counters.resizes > 0 && ss.counters.moved_bytes > 0);
+	assert(ss.counters.lookups == ss.counters.hits + ss.counters.misses);
+	assert(ss.counters.misses >= 1000);
+	hits = ss.counters.hits;
+	for (i = 1; i <= 1000; i++)
+		assert(stats_get(b, i, 0) == i);
+	assert(stats_get(b, 1001, 0) == 0);
+	stats_stats(b, &ss);
+	assert(ss.counters.hits == hits + 1000);
+	assert(ss.counters.probes >= ss.counters.lookups);
+	assert(ss.counters.max_probes >= 1);
+	assert(ss.counters.max_probes <= ss.max_cluster + 1);
+	stats_destroy(b);
+}
+
+/*
+ * Snapshots taken before and between modifications and resizes, seeing the
+ * values as they were, and a snapshot of a destroyed table
+ */
+#define SNAPSHOT_TEST(prefix, value_t)                                        \
+	void prefix##_snapshot_check(struct prefix##_snapshot *s, int n,      \
+	                             int odd, int even) {                     \
+		int key, count = 0;                                           \
+		value_t v;                                                    \
+		OAHT_SIZE_T pos = 0;                                          \
+		assert(prefix##_snapshot_len(s) == (OAHT_SIZE_T)n);           \
+		for (key = 1; key <= n + 1; key++) {                          \
+			value_t expected = key > n ? -1 : key * (key % 2 ? odd : even); \
+			assert(prefix##_snapshot_get(s, key, -1) == expected); \
+			assert(prefix##_snapshot_contains(s, key) == (key <= n)); \
+		}                                                             \
+		while ((pos = prefix##_snapshot_iter(s, pos, &key, &v))) {    \
+			assert(v == key * (key % 2 ? odd : even));            \
+			count++;                                              \
+		}                                                             \
+		assert(count == n);                                           \
+	}                                                                     \
+	void prefix##_snapshot_test(void) {                                   \
+		struct prefix##_snapshot *s1, *s2, *s3;                       \
+		struct prefix * ht = prefix##_create();                       \
+		int key;                                                      \
+		for (key = 1; key <= 2000; key++)                             \
+			ht = prefix##_set(ht, key, key);                      \
+		s1 = prefix##_snapshot(ht);                                   \
+		for (key = 1; key <= 2000; key += 2)                          \
+			ht = prefix##_set(ht, key, key * 10);                 \
+		s2 = prefix##_snapshot(ht);                                   \
+		for (key = 1; key <= 2000; key += 4)                          \
+			*prefix##_get_ptr(ht, key) = 0;                       \
+		for (key = 3; key <= 2000; key += 4)                          \
+			(*prefix##_upsert(&ht, key, NULL))++;                 \
+		prefix##_snapshot_check(s1, 2000, 1, 1);                         \
+		prefix##_snapshot_check(s2, 2000, 10, 1);                        \
+		/* deleting shrinks the table, and inserting grows it */      \
+		for (key = 1; key <= 2000; key++)                             \
+			ht = prefix##_delete(ht, key);                        \
+		assert(prefix##_len(ht) == 0);                                \
+		prefix##_snapshot_check(s1, 2000, 1, 1);                         \
+		prefix##_snapshot_release(s1);                                \
+		for (key = 1; key <= 20000; key++)                            \
+			ht = prefix##_set(ht, key, key * 3);                  \
+		s3 = prefix##_snapshot(ht);                                   \
+		prefix##_snapshot_check(s2, 2000, 10, 1);                        \
+		prefix##_snapshot_release(s2);                                \
+		ht = prefix##_compact(ht);                                    \
+		prefix##_destroy(ht);                                         \
+		prefix##_snapshot_check(s3, 20000, 3, 3);                     \
+		prefix##_snapshot_release(s3);                                \
+	}
+
+SNAPSHOT_TEST(snap, int)
+SNAPSHOT_TEST(snap_rh, int)
+SNAPSHOT_TEST(snap_soa, double)
+SNAPSHOT_TEST(snap_small, int)
+
+/* A snapshot read by another thread while the table is modified */
+static void *snapshot_reader(void *arg) {
+	struct snap_snapshot *s = (struct snap_snapshot *)arg;
+	int i, key, value, count;
+	for (i = 0; i < 20; i++) {
+		OAHT_SIZE_T pos = 0;
+		count = 0;
+		while ((pos = snap_snapshot_iter(s, pos, &key, &value))) {
+			assert(value == key);
+			count++;
+		}
+		assert(count == 10000);
+		assert(snap_snapshot_get(s, i + 1, 0) == i + 1);
+	}
+	return NULL;
+}
+
+void snapshot_test(void) {
+	struct snap * ht = snap_create();
+	struct snap_snapshot *s;
+	pthread_t reader;
+	int i, key;
+	snap_snapshot_test();
+	snap_rh_snapshot_test();
+	snap_soa_snapshot_test();
+	snap_small_snapshot_test();
+	for (key = 1; key <= 10000; key++)
+		ht = snap_set(ht, key, key);
+	s = snap_snapshot(ht);
+	/* only the pages written to are copied */
+	ht = snap_set(ht, 1, -1);
+	for (i = 0, key = 0; i <= (int)(s->mask / 16); i++)
+		key += s->pages[i] != NULL;
+	assert(key == 1);
+	assert(pthread_create(&reader, NULL, snapshot_reader, s) == 0);
+	for (i = 0; i < 20; i++) {
+		for (key = 1; key <= 10000; key++)
+			ht = snap_set(ht, key, -key);
+		for (key = 1; key <= 10000; key += 3)
+			ht = snap_delete(ht, key);
+		for (key = 10001; key <= 10000 + 1000 * i; key++)
+			ht = snap_set(ht, key, key);
+	}
+	pthread_join(reader, NULL);
+	snap_snapshot_release(s);
+	snap_destroy(ht);
+}
+
+/*
+ * Sets of strided keys with seeded hashes which aren't stored. The hashes are
+ * computed again when the tables grow and when entries are moved.
+ */
+#define COMPACT_TEST(prefix)                                                  \
+	void prefix##_compact_test(void) {                                    \
+		int i, n = 20000;                                             \
+		struct prefix * a = prefix##_create();                        \
+		struct prefix * b = prefix##_create();                        \
+		assert(sizeof(struct prefix##_entry) == sizeof(int));         \
+		assert(a->seed != b->seed);                                   \
+		for (i = 1; i <= n; i++) {                                    \
+			a = prefix##_add(a, i * 4096);                        \
+			b = prefix##_add(b, i * 4096);                        \
+		}                                                             \
+		for (i = 1; i <= n; i += 2)                                   \
+			a = prefix##_delete(a, i * 4096);                     \
+		assert(prefix##_len(a) == (unsigned)n / 2);                   \
+		for (i = 1; i <= n; i++) {                                    \
+			assert(prefix##_contains(a, i * 4096) == (i % 2 == 0)); \
+			assert(prefix##_contains(b, i * 4096));               \
+			assert(prefix##_contains_h(b, i * 4096,               \
+			       prefix##_hash(b, i * 4096)));                  \
+		}                                                             \
+		assert(!prefix##_contains(b, 4095));                          \
+		a = prefix##_compact(a);                                      \
+		for (i = 1; i <= n; i++)                                      \
+			assert(prefix##_contains(a, i * 4096) == (i % 2 == 0)); \
+		prefix##_destroy(a);                                          \
+		prefix##_destroy(b);                                          \
+	}
+
+COMPACT_TEST(fpset)
+COMPACT_TEST(fpset_rh)
+
+void compact_set_test(void) {
+	fpset_compact_test();
+	fpset_rh_compact_test();
+}
+
+/*
+ * Sets of consecutive and of strided keys. They grow only at the maximum load,
+ * shrink when most keys are deleted and keep the keys in cache line aligned
+ * buckets.
+ */
+#define CUCKOO_TEST(prefix, stride)                                           \
+	void prefix##_cuckoo_test(void) {                                     \
+		int i, k, n = 100000;                                         \
+		long long sum = 0;                                            \
+		unsigned int pos = 0, slots;                                  \
+		struct prefix * c = prefix##_create();                        \
+		for (i = 1; i <= n; i++) {                                    \
+			slots = (c->mask + 1) * OAHT_CUCKOO_SLOTS;            \
+			if (i % 3 == 0)                                       \
+				c = prefix##_add(c, (i - 1) * stride);        \
+			c = prefix##_add(c, i * stride);                      \
+			if (slots >= 1024 && (c->mask + 1) * OAHT_CUCKOO_SLOTS != slots) \
+				assert((unsigned)(i - 1) >= slots * 9 / 10);  \
+		}                                                             \
+		assert(((size_t)prefix##_buckets(c) & (OAHT_CACHE_LINE - 1)) == 0); \
+		assert(prefix##_len(c) == (unsigned)n);                       \
+		for (i = 1; i <= n; i++) {                                    \
+			assert(prefix##_contains(c, i * stride));             \
+			assert(!prefix##_contains(c, -i * stride));           \
+		}                                                             \
+		for (i = 1; i <= n; i += 2)                                   \
+			c = prefix##_delete(c, i * stride);                   \
+		c = prefix##_delete(c, -stride);                              \
+		assert(prefix##_len(c) == (unsigned)n / 2);                   \
+		for (i = 1; i <= n; i++)                                      \
+			assert(prefix##_contains(c, i * stride) == (i % 2 == 0)); \
+		while ((pos = prefix##_iter(c, pos, &k)))                     \
+			sum += k / stride;                                    \
+		assert(sum == (long long)(n / 2) * (n / 2 + 1));              \
+		slots = (c->mask + 1) * OAHT_CUCKOO_SLOTS;                    \
+		for (i = 2; i <= n - 100; i += 2)                             \
+			c = prefix##_delete(c, i * stride);                   \
+		assert((c->mask + 1) * OAHT_CUCKOO_SLOTS < slots / 8);        \
+		assert(prefix##_len(c) == 50);                                \
+		for (i = n - 99; i <= n; i++)                                 \
+			assert(prefix##_contains(c, i * stride) == (i % 2 == 0)); \
+		c = prefix##_reserve(c, n);                                   \
+		assert((c->mask + 1) * OAHT_CUCKOO_SLOTS >= (unsigned)n);     \
+		for (i = n - 99; i <= n; i++)                                 \
+			assert(prefix##_contains(c, i * stride) == (i % 2 == 0)); \
+		prefix##_destroy(c);                                          \
+	}
+
+CUCKOO_TEST(cuckoo, 1)
+CUCKOO_TEST(cuckoo_fn, 4096)
+
+void cuckoo_test(void) {
+	struct cuckoo_fn * a = cuckoo_fn_create();
+	struct cuckoo_fn * b = cuckoo_fn_create();
+	cuckoo_cuckoo_test();
+	cuckoo_fn_cuckoo_test();
+	assert(a->seed != b->seed);
+	cuckoo_fn_destroy(a);
+	cuckoo_fn_destroy(b);
+}
+
+/*
+ * Set operations on the even and the multiples of 3 of the keys 1 to 6000,
+ * and on a few multiples of 6. The operands are unchanged.
+ */
+#define SET_OPS_TEST(prefix)                                                  \
+	static void prefix##_set_ops_check(                                   \
+		struct prefix *(*un)(struct prefix *, struct prefix *),       \
+		struct prefix *(*in)(struct prefix *, struct prefix *),       \
+		struct prefix *(*df)(struct prefix *, struct prefix *)) {     \
+		int k;                                                        \
+		struct prefix * a = prefix##_create();                        \
+		struct prefix * b = prefix##_create();                        \
+		struct prefix * c = prefix##_create();                        \
+		struct prefix * r[4];                                         \
+		for (k = 1; k <= 6000; k++) {                                 \
+			if (k % 2 == 0)                                       \
+				a = prefix##_add(a, k);                       \
+			if (k % 3 == 0)                                       \
+				b = prefix##_add(b, k);                       \
+		}                                                             \
+		for (k = 6; k <= 30; k += 6)                                  \
+			c = prefix##_add(c, k);                               \
+		r[0] = un(a, b);                                              \
+		r[1] = in(a, b);                                              \
+		r[2] = df(a, b);                                              \
+		r[3] = df(b, a);                                              \
+		assert(prefix##_len(r[0]) == 4000);                           \
+		assert(prefix##_len(r[1]) == 1000);                           \
+		assert(prefix##_len(r[2]) == 2000);                           \
+		assert(prefix##_len(r[3]) == 1000);                           \
+		for (k = 1; k <= 6000; k++) {                                 \
+			int ina = k % 2 == 0, inb = k % 3 == 0;               \
+			assert(prefix##_contains(r[0], k) == (ina || inb));   \
+			assert(prefix##_contains(r[1], k) == (ina && inb));   \
+			assert(prefix##_contains(r[2], k) == (ina && !inb));  \
+			assert(prefix##_contains(r[3], k) == (inb && !ina));  \
+			assert(prefix##_contains(a, k) == ina);               \
+			assert(prefix##_contains(b, k) == inb);               \
+		}                                                             \
+		for (k = 0; k < 4; k++)                                       \
+			prefix##_destroy(r[k]);                               \
+		r[0] = un(c, b);                                              \
+		r[1] = in(c, a);                                              \
+		r[2] = df(a, c);                                              \
+		r[3] = df(c, a);                                              \
+		assert(prefix##_len(r[0]) == 2000);                           \
+		assert(prefix##_len(r[1]) == 5);                              \
+		assert(prefix##_len(r[2]) == 2995);                           \
+		assert(prefix##_len(r[3]) == 0);                              \
+		for (k = 6; k <= 36; k += 6) {                                \
+			assert(prefix##_contains(r[1], k) == (k <= 30));      \
+			assert(prefix##_contains(r[2], k) == (k > 30));       \
+		}                                                             \
+		for (k = 0; k < 4; k++)                                       \
+			prefix##_destroy(r[k]);                               \
+		prefix##_destroy(a);                                          \
+		prefix##_destroy(b);                                          \
+		prefix##_destroy(c);                                          \
+	}                                                                     \
+	void prefix##_set_ops_test(void) {                                    \
+		prefix##_set_ops_check(prefix##_union, prefix##_intersect,    \
+		                       prefix##_difference);                  \
+	}
+
+/* The parallel set operations using n threads */
+#define SET_OPS_PARALLEL_TEST(prefix, n)                                      \
+	static struct prefix *                                                \
+	prefix##_union_##n(struct prefix *a, struct prefix *b) {              \
+		return prefix##_union_parallel(a, b, n);                      \
+	}                                                                     \
+	static struct prefix *                                                \
+	prefix##_intersect_##n(struct prefix *a, struct prefix *b) {          \
+		return prefix##_intersect_parallel(a, b, n);                  \
+	}                                                                     \
+	static struct prefix *                                                \
+	prefix##_difference_##n(struct prefix *a, struct prefix *b) {         \
+		return prefix##_difference_parallel(a, b, n);                 \
+	}                                                                     \
+	void prefix##_set_ops_##n##_test(void) {                              \
+		prefix##_set_ops_check(prefix##_union_##n,                    \
+		                       prefix##_intersect_##n,                \
+		                       prefix##_difference_##n);              \
+	}
+
+SET_OPS_TEST(keyset)
+SET_OPS_TEST(fpset)
+SET_OPS_TEST(algset)
+SET_OPS_TEST(algset_inc)
+SET_OPS_PARALLEL_TEST(algset, 1)
+SET_OPS_PARALLEL_TEST(algset, 3)
+SET_OPS_PARALLEL_TEST(algset_inc, 4)
+
+void set_ops_test(void) {
+	keyset_set_ops_test();
+	fpset_set_ops_test();
+	algset_set_ops_test();
+	algset_inc_set_ops_test();
+	algset_set_ops_1_test();
+	algset_set_ops_3_test();
+	algset_inc_set_ops_4_test();
+}
+
+/*
+ * Sums the keys and values of the entries of a range and increments the
+ * values, for maps (kv) and sets (k)
+ */
+struct range_sum {
+	long long keys, values;
+	int n;
+};
+
+static void range_sum_kv(void *arg, int const *key, int *value) {
+	struct range_sum *s = (struct range_sum *)arg;
+	s->keys += *key;
+	s->values += (*value)++;
+	s->n++;
+}
+
+static void range_sum_k(void *arg, int const *key) {
+	struct range_sum *s = (struct range_sum *)arg;
+	s->keys += *key;
+	s->n++;
+}
+
+/* Keeps the keys which aren't multiples of 3, counting the calls */
+static int keep_k(void *arg, int const *key) {
+	(*(int *)arg)++;
+	return *key % 3 != 0;
+}
+
+static int keep_kv(void *arg, int const *key, int *value) {
+	(void)value;
+	return keep_k(arg, key);
+}
+
+static int keep_none_k(void *arg, int const *key) {
+	(void)arg;
+	(void)key;
+	return 0;
+}
+
+static int keep_none_kv(void *arg, int const *key, int *value) {
+	(void)value;
+	return keep_none_k(arg, key);
+}
+
+#define PUT_kv(prefix, t, k) prefix##_set(t, k, 2 * (k))
+#define PUT_k(prefix, t, k) prefix##_add(t, k)
+
+/*
+ * Iterating over ranges of the keys stride, 2 * stride, ..., n * stride and
+ * removing the multiples of 3, then all of them. The values are 2 * key, or
+ * there are none.
+ */
+#define RETAIN_TEST(prefix, kind)                                             \
+	void prefix##_retain_test(int n, int stride) {                        \
+		struct prefix * t = prefix##_create();                        \
+		struct range_sum s1 = {0, 0, 0}, s2 = {0, 0, 0};              \
+		int i, calls = 0;                                             \
+		unsigned end;                                                 \
+		for (i = 1; i <= n; i++)                                      \
+			t = PUT_##kind(prefix, t, i * stride);                \
+		end = prefix##_slots(t);                                      \
+		prefix##_for_each_range(t, 0, end / 3, range_sum_##kind,      \
+		                        &s1);                                 \
+		prefix##_for_each_range(t, end / 3, end, range_sum_##kind,    \
+		                        &s1);                                 \
+		prefix##_for_each_range(t, 0, end, range_sum_##kind, &s2);    \
+		assert(s1.n == n && s2.n == n);                               \
+		assert(s1.keys == (long long)n * (n + 1) / 2 * stride);       \
+		assert(s2.keys == s1.keys);                                   \
+		assert(s1.values == 0 || s1.values == 2 * s1.keys);           \
+		assert(s2.values == (s1.values ? s1.values + n : 0));         \
+		t = prefix##_retain(t, keep_##kind, &calls);                  \
+		assert(calls == n);                                           \
+		assert(prefix##_len(t) == (unsigned)(n - n / 3));             \
+		for (i = 1; i <= n; i++)                                      \
+			assert(prefix##_contains(t, i * stride) ==            \
+			       (i % 3 != 0));                                 \
+		calls = 0;                                                    \
+		t = prefix##_retain(t, keep_##kind, &calls);                  \
+		assert(calls == n - n / 3);                                   \
+		t = prefix##_retain(t, keep_none_##kind, NULL);               \
+		assert(prefix##_len(t) == 0);                                 \
+		for (i = 1; i <= n; i++)                                      \
+			assert(!prefix##_contains(t, i * stride));            \
+		t = PUT_##kind(prefix, t, stride);                            \
+		assert(prefix##_len(t) == 1 && prefix##_contains(t, stride)); \
+		prefix##_destroy(t);                                          \
+	}
+
+/* The same using nthreads threads and an argument per thread */
+#define RETAIN_PARALLEL_TEST(prefix, kind)                                    \
+	void prefix##_retain_parallel_test(int n, int stride,                 \
+	                                   unsigned nthreads) {               \
+		struct prefix * t = prefix##_create();                        \
+		struct range_sum s[8] = {{0, 0, 0}};                          \
+		int i, calls[8] = {0}, total = 0, keys = 0;                    \
+		void *args[8];                                                \
+		assert(nthreads <= 8);                                        \
+		for (i = 1; i <= n; i++)                                      \
+			t = PUT_##kind(prefix, t, i * stride);                \
+		for (i = 0; i < 8; i++)                                       \
+			args[i] = &s[i];                                      \
+		prefix##_for_each_parallel(t, range_sum_##kind, args,         \
+		                           nthreads);                         \
+		for (i = 0; i < 8; i++) {                                     \
+			keys += s[i].keys / stride;                           \
+			total += s[i].n;                                      \
+			args[i] = &calls[i];                                  \
+		}                                                             \
+		assert(total == n);                                           \
+		assert(keys == n * (n + 1) / 2);                              \
+		t = prefix##_retain_parallel(t, keep_##kind, args, nthreads); \
+		for (i = 0, total = 0; i < 8; i++)                            \
+			total += calls[i];                                    \
+		assert(total == n);                                           \
+		assert(prefix##_len(t) == (unsigned)(n - n / 3));             \
+		for (i = 1; i <= n; i++)                                      \
+			assert(prefix##_contains(t, i * stride) ==            \
+			       (i % 3 != 0));                                 \
+		t = prefix##_retain_parallel(t, keep_none_##kind, args,       \
+		                             nthreads);                       \
+		assert(prefix##_len(t) == 0);                                 \
+		prefix##_destroy(t);                                          \
+	}
+
+RETAIN_TEST(oaht, kv)
+RETAIN_TEST(inc, kv)
+RETAIN_TEST(bs, kv)
+RETAIN_TEST(rh, kv)
+RETAIN_TEST(cb, kv)
+RETAIN_TEST(cr, kv)
+RETAIN_TEST(small, kv)
+RETAIN_TEST(snap_rh, kv)
+RETAIN_TEST(keyset, k)
+RETAIN_TEST(fpset_rh, k)
+RETAIN_PARALLEL_TEST(par, kv)
+RETAIN_PARALLEL_TEST(par_rh, kv)
+RETAIN_PARALLEL_TEST(algset, k)
+RETAIN_PARALLEL_TEST(algset_inc, k)
+
+void retain_test(void) {
+	struct inc * ht = inc_create();
+	struct snap * sn = snap_create();
+	struct snap_snapshot *s;
+	int i, calls = 0;
+	unsigned nthreads = 4;
+	/* the ranges are rounded up to 64 slots, with the last one the shortest */
+	assert(par_range_step(1024, &nthreads) == 256 && nthreads == 4);
+	nthreads = 3;
+	assert(par_range_step(1024, &nthreads) == 384 && nthreads == 3);
+	nthreads = 8;
+	assert(par_range_step(100, &nthreads) == 64 && nthreads == 2);
+	oaht_retain_test(2000, 1);
+	oaht_retain_test(2000, 1024);
+	inc_retain_test(2000, 1);
+	bs_retain_test(2000, 1);
+	bs_retain_test(2000, 7);
+	rh_retain_test(2000, 1);
+	rh_retain_test(2000, 1024);
+	cb_retain_test(2000, 4);
+	cr_retain_test(2000, 1);
+	small_retain_test(10, 1);
+	small_retain_test(2000, 1);
+	snap_rh_retain_test(2000, 1);
+	keyset_retain_test(2000, 1);
+	fpset_rh_retain_test(2000, 65536);
+	/* consecutive keys, in one long cluster, and strided ones */
+	par_retain_parallel_test(20000, 1, 4);
+	par_retain_parallel_test(20000, 64, 3);
+	par_rh_retain_parallel_test(20000, 1, 4);
+	par_rh_retain_parallel_test(20000, 5, 8);
+	par_rh_retain_parallel_test(10, 1, 8);
+	algset_retain_parallel_test(20000, 1, 3);
+	algset_retain_parallel_test(5, 1, 2);
+	algset_inc_retain_parallel_test(3000, 1, 4);
+	/* during an incremental resize, both tables are retained */
+	for (i = 1; !ht->old; i++)
+		ht = inc_set(ht, i, i);
+	ht = inc_retain(ht, keep_kv, &calls);
+	assert(calls == i - 1);
+	assert(inc_len(ht) == (unsigned)(i - 1 - (i - 1) / 3));
+	for (calls = 1; calls < i; calls++)
+		assert(inc_get(ht, calls, 0) == (calls % 3 ? calls : 0));
+	inc_destroy(ht);
+	/* a snapshot taken before is unchanged */
+	for (i = 1; i <= 1000; i++)
+		sn = snap_set(sn, i, i);
+	s = snap_snapshot(sn);
+	calls = 0;
+	sn = snap_retain(sn, keep_kv, &calls);
+	assert(snap_len(sn) == 667 && snap_snapshot_len(s) == 1000);
+	for (i = 1; i <= 1000; i++) {
+		assert(snap_contains(sn, i) == (i % 3 != 0));
+		assert(snap_snapshot_get(s, i, 0) == i);
+	}
+	snap_snapshot_release(s);
+	snap_destroy(sn);
+}
+
 int main() {
 	get_test();
 	iter_test();
 	iter_empty_test();
+	next_test();
+	keyset_iter_test();
 	large_table_test();
+	get_many_test();
+	set_many_test();
+	reserve_test();
+	incremental_resize_test();
+	grow_in_place_test();
+	compact_test();
+	backshift_delete_test();
+	incremental_backshift_test();
+	robin_hood_test();
+	control_bytes_test();
+	soa_test();
+	concurrent_read_test();
+	sharded_test();
+	resize_parallel_test();
+	small_test();
+	build_from_test();
+	mmap_test();
+	pool_test();
+	scan_test();
+	hash_fn_test();
+	stats_test();
+	upsert_test();
+	hash_given_test();
+	huge_test();
+	snapshot_test();
+	compact_set_test();
+	cuckoo_test();
+	set_ops_test();
+	retain_test();
 	return 0;
 }